@@ -0,0 +1,113 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "access_map.hh"
+#include "exception.hh"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+const char access_map::magic[8] {'g', 'j', 'a', 'm', 'a', 'p', '2', 0};
+
+// *********************************************************
+
+access_map::access_map(const std::string &file)
+    : data{MAP_FAILED},
+      size{0},
+      hdr{nullptr},
+      entries{nullptr},
+      strings{nullptr}
+{
+    const int fd =open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throw import_exception{};
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0
+        && static_cast<size_t>(st.st_size) >= sizeof(header))
+    {
+        size =st.st_size;
+        data =mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+        throw import_exception{};
+
+    // validate
+
+    hdr =static_cast<const header *>(data);
+
+    const uint64_t buckets_size =uint64_t{hdr->bucket_count} * sizeof(entry);
+
+    if (memcmp(hdr->magic, magic, sizeof(magic)) != 0
+        || hdr->bucket_count == 0
+        || (hdr->bucket_count & (hdr->bucket_count - 1)) != 0
+        || sizeof(header) + buckets_size + hdr->strings_size > size)
+    {
+        munmap(const_cast<void *>(data), size);
+        throw import_exception{};
+    }
+
+    entries =reinterpret_cast<const entry *>(static_cast<const char *>(data) + sizeof(header));
+    strings =reinterpret_cast<const char *>(entries + hdr->bucket_count);
+}
+
+access_map::~access_map()
+{
+    munmap(const_cast<void *>(data), size);
+}
+
+const access_map::entry *access_map::find(const char *path, size_t size) const
+{
+    const uint64_t h =hash(path, size);
+    const uint32_t mask =hdr->bucket_count - 1;
+
+    for (uint32_t i =h & mask, probes =0;
+         probes < hdr->bucket_count;
+         i =(i + 1) & mask, ++probes)
+    {
+        const entry &e =entries[i];
+
+        if (e.path_size == 0)
+            break;
+
+        if (e.hash == h
+            && e.path_size == size
+            && uint64_t{e.path_offset} + e.path_size <= hdr->strings_size
+            && memcmp(strings + e.path_offset, path, size) == 0)
+        {
+            return &e;
+        }
+    }
+
+    return nullptr;
+}
+
+// *********************************************************
+
+uint64_t access_map::hash(const char *data, size_t size)
+{
+    // 64-bit FNV-1a
+
+    uint64_t h =14695981039346656037ull;
+
+    for (size_t i =0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
@@ -0,0 +1,62 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_ACCESS_MAP_HEADER
+#define GIT_JUNCTION_ACCESS_MAP_HEADER
+
+#include "config.hh"
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Compiled, read-only map from repository path to the access information
+// junction-shell needs. It is an open addressing hash table, written by
+// access_map_builder and memory-mapped by junction-shell.
+
+class access_map {
+public:
+    struct header {
+        char magic[8];
+        uint32_t bucket_count;          // power of two
+        uint32_t strings_size;
+    };
+
+    struct entry {
+        uint64_t hash;
+        uint32_t path_offset;
+        uint16_t path_size;             // zero marks an empty bucket
+        uint8_t  type;                  // cgitrc::repo_type
+        uint8_t  publicity;
+        uint32_t flags;                 // cgitrc::get_flags()
+        char     owner[config::user_max_size + 1];
+    };
+
+    static const char magic[8];
+
+private:
+    const void *data;
+    size_t size;
+
+    const header *hdr;
+    const entry *entries;
+    const char *strings;
+
+public:
+    access_map(const std::string &file);
+    ~access_map();
+
+    access_map(const access_map &) =delete;
+    access_map &operator= (const access_map &) =delete;
+
+    const entry *find(const char *path, size_t size) const;
+
+    //
+
+    static uint64_t hash(const char *data, size_t size);
+};
+
+#endif
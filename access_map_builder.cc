@@ -0,0 +1,139 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "access_map_builder.hh"
+#include "access_map.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "utils.hh"
+
+#include <sstream>
+#include <fstream>
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+//
+
+class access_map_builder::scanner : public git_dir_functor {
+    access_map_builder &builder;
+public:
+    scanner(access_map_builder &b)
+        : builder{b} {}
+
+    virtual void operator() (const std::string &path) const
+    {
+        try {
+            const cgitrc rc =cgitrc::import_from_file(path + "/cgitrc");
+
+            const bool publicity = (rc.get_type() == cgitrc::repo_type::shared) ? read_publicity(path) : false;
+
+            builder.add_repository(path, rc, publicity);
+        }
+        catch (import_exception) {
+        }
+    }
+};
+
+// *********************************************************
+
+access_map_builder::access_map_builder()
+{
+    for_each_git_dir(scanner(*this));
+}
+
+void access_map_builder::add_repository(const std::string &path, const cgitrc &rc, bool publicity)
+{
+    if (path.size() > UINT16_MAX
+        || rc.get_owner().size() > config::user_max_size)
+    {
+        return;
+    }
+
+    records.push_back(record{path, rc, publicity});
+}
+
+void access_map_builder::export_to_file(const std::string &file) const
+{
+    // keep the load factor at or below 1/2
+
+    uint32_t bucket_count =1;
+
+    while (bucket_count < records.size() * 2)
+        bucket_count <<= 1;
+
+    std::vector<access_map::entry> buckets(bucket_count);
+    std::string strings;
+
+    memset(buckets.data(), 0, bucket_count * sizeof(access_map::entry));
+
+    for (auto ptr =records.begin();
+         ptr != records.end();
+         ++ptr)
+    {
+        access_map::entry e;
+        memset(&e, 0, sizeof(e));
+
+        e.hash        =access_map::hash(ptr->path.data(), ptr->path.size());
+        e.path_offset =strings.size();
+        e.path_size   =ptr->path.size();
+        e.type        =static_cast<uint8_t>(ptr->rc.get_type());
+        e.publicity   =ptr->publicity;
+        e.flags       =ptr->rc.get_flags();
+        memcpy(e.owner, ptr->rc.get_owner().data(), ptr->rc.get_owner().size());
+
+        strings += ptr->path;
+
+        uint32_t i =e.hash & (bucket_count - 1);
+
+        while (buckets[i].path_size != 0)
+            i =(i + 1) & (bucket_count - 1);
+
+        buckets[i] =e;
+    }
+
+    access_map::header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    memcpy(hdr.magic, access_map::magic, sizeof(hdr.magic));
+    hdr.bucket_count =bucket_count;
+    hdr.strings_size =strings.size();
+
+    // write to a temporary file and rename it over the old map, so that
+    // junction-shell always sees a complete file
+
+    std::ostringstream tmp_oss;
+    tmp_oss << file << ".tmp." << getpid();
+
+    const std::string tmp_file =tmp_oss.str();
+
+    {
+        std::ofstream ofs{tmp_file, std::ios::binary};
+
+        if (!ofs
+            || !ofs.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr))
+            || !ofs.write(reinterpret_cast<const char *>(buckets.data()), bucket_count * sizeof(access_map::entry))
+            || !ofs.write(strings.data(), strings.size())
+            || !ofs.flush())
+        {
+            unlink(tmp_file.c_str());
+            throw generic_exception{"access map export failed (" + tmp_file + ")"};
+        }
+    }
+
+    if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+        const int error =errno;
+        unlink(tmp_file.c_str());
+        throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", error};
+    }
+}
+
+void access_map_builder::rebuild()
+{
+    access_map_builder{}.export_to_file(config::access_map_file);
+}
@@ -0,0 +1,40 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_ACCESS_MAP_BUILDER_HEADER
+#define GIT_JUNCTION_ACCESS_MAP_BUILDER_HEADER
+
+#include "cgitrc.hh"
+
+#include <string>
+#include <vector>
+
+class access_map_builder {
+    class scanner;
+
+    struct record {
+        std::string path;
+        cgitrc rc;
+        bool publicity;
+    };
+
+    //
+
+    std::vector<record> records;
+
+    access_map_builder();
+
+    void add_repository(const std::string &path, const cgitrc &rc, bool publicity);
+    void export_to_file(const std::string &file) const;
+
+public:
+    // scans all repositories under config::base_path and replaces
+    // config::access_map_file atomically
+
+    static void rebuild();
+};
+
+#endif
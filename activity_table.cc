@@ -0,0 +1,112 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "activity_table.hh"
+#include "config.hh"
+
+#include <cstring>
+#include <ctime>
+
+//
+
+activity_table::activity_table(bool writable)
+    : shm{config::activity_shm_name, sizeof(segment), writable},
+      seg{static_cast<segment *>(shm.get())}
+{
+    if (writable)
+        shm.claim_version(version);
+}
+
+void activity_table::record(uint64_t hash, const char *path, shell_stats::command_t command)
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return;
+
+    if (hash == 0)
+        hash =1;
+
+    for (unsigned int i =0; i < probe_limit; ++i)
+    {
+        slot &s =seg->slots[(hash + i) & (slot_count - 1)];
+
+        uint64_t expected =0;
+
+        if (!__atomic_compare_exchange_n(&s.hash, &expected, hash, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            if (expected != hash)
+                continue;       // somebody else's slot
+        }
+        else
+        {
+            // claimed, nobody else writes the path
+
+            strncpy(s.path, path, path_size - 1);
+            __atomic_store_n(&s.ready, 1, __ATOMIC_RELEASE);
+        }
+
+        const uint64_t now =time(nullptr);
+
+        __atomic_fetch_add(&s.counts[command], 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&s.last_access, now, __ATOMIC_RELAXED);
+
+        if (command == shell_stats::c_receive_pack)
+            __atomic_store_n(&s.last_push, now, __ATOMIC_RELAXED);
+
+        return;
+    }
+}
+
+const activity_table::slot *activity_table::get(unsigned int index) const
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return nullptr;
+
+    const slot &s =seg->slots[index];
+
+    if (!__atomic_load_n(&s.ready, __ATOMIC_ACQUIRE))
+        return nullptr;
+
+    return &s;
+}
+
+const activity_table::slot *activity_table::find(uint64_t hash, const std::string &path) const
+{
+    if (hash == 0)
+        hash =1;
+
+    for (unsigned int i =0; i < probe_limit; ++i)
+    {
+        const unsigned int index =(hash + i) & (slot_count - 1);
+        const uint64_t h =__atomic_load_n(&seg->slots[index].hash, __ATOMIC_ACQUIRE);
+
+        if (h == 0)
+            return nullptr;
+        if (h != hash)
+            continue;
+
+        const slot *s =get(index);
+
+        if (s
+            && path.compare(0, path_size - 1, s->path) == 0)
+        {
+            return s;
+        }
+
+        return nullptr;
+    }
+
+    return nullptr;
+}
+
+void activity_table::touch(uint64_t hash, const char *path, shell_stats::command_t command)
+{
+    try {
+        activity_table{true}.record(hash, path, command);
+    }
+    catch (...) {
+    }
+}
@@ -0,0 +1,64 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_ACTIVITY_TABLE_HEADER
+#define GIT_JUNCTION_ACTIVITY_TABLE_HEADER
+
+#include "shell_stats.hh"
+#include "shm_segment.hh"
+
+#include <string>
+#include <cstdint>
+
+// Per repository command counts and timestamps, in a fixed-size open
+// addressing table in shared memory. A slot is claimed by a compare and
+// swap of its hash (see access_map::hash, 0 means empty); the path is
+// published after it, so readers skip slots that aren't ready yet. When the
+// table is full, new repositories are not counted.
+
+class activity_table {
+public:
+    enum {
+        version      =2,        // bump when the segment layout changes
+        slot_count   =4096,     // a power of two
+        probe_limit  =64,
+        path_size    =256,      // longer paths are truncated
+    };
+
+    struct slot {
+        uint64_t hash;
+        uint64_t counts[shell_stats::command_count];
+        uint64_t last_access;   // seconds since the epoch
+        uint64_t last_push;
+        uint32_t ready;
+        char path[path_size];
+    };
+
+    struct segment {
+        uint64_t version;
+        slot slots[slot_count];
+    };
+
+private:
+    shm_segment shm;
+    segment *seg;
+
+public:
+    activity_table(bool writable);
+
+    void record(uint64_t hash, const char *path, shell_stats::command_t);
+
+    // returns nullptr for an empty or unfinished slot
+    const slot *get(unsigned int index) const;
+
+    // the slot of a repository, nullptr if it has none
+    const slot *find(uint64_t hash, const std::string &path) const;
+
+    // best effort, a failure never prevents a connection
+    static void touch(uint64_t hash, const char *path, shell_stats::command_t);
+};
+
+#endif
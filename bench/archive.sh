@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# git archive --remote --format=tar.gz through junction-shell of a tree
+# of $MIB MiB (2048 by default) of text, for comparing a build with
+# config::archive_gzip_threads against one where git compresses, passed
+# as BASELINE=<directory> and configured with the same config::base_path.
+# Checks that gunzip restores the tar that git archive makes locally.
+# See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+MIB="${MIB:-2048}"
+
+new_repo archive
+
+R="$BASE/archive.git"
+
+# files of 1 MiB of lines of words, which gzip to less than half
+
+python3 - "$MIB" > "$TMP/tree" <<'EOF'
+import random
+import sys
+
+random.seed(1)
+words =['%x' % random.getrandbits(random.choice((8, 16, 24, 32))) for _ in range(4096)]
+
+out =sys.stdout
+out.write('commit refs/heads/master\n')
+out.write('committer bench <bench@localhost> 1500000000 +0000\n')
+out.write('data 7\narchive')
+
+for f in range(int(sys.argv[1])):
+    lines =[]
+    size =0
+
+    while size < 1 << 20:
+        line =' '.join(random.choices(words, k=random.randint(2, 12)))
+        lines.append(line)
+        size += len(line) + 1
+
+    data ='\n'.join(lines) + '\n'
+    out.write('\nM 100644 inline dir.%d/file.%d\ndata %d\n%s' % (f // 64, f, len(data), data))
+
+out.write('\n')
+EOF
+
+git --git-dir="$R" fast-import --quiet < "$TMP/tree" || exit 1
+
+rm -f "$TMP/tree"
+
+sed "s|$JUNCTION/junction-shell|$BASELINE/junction-shell|" "$TMP/ssh" > "$TMP/ssh-baseline"
+chmod +x "$TMP/ssh-baseline"
+
+archive()
+{
+    GIT_SSH_COMMAND="$1" git archive --remote=ssh://bench/archive.git --format=tar.gz master > "$TMP/archive.tar.gz"
+}
+
+# measure <ssh command>: archive throughput, and the CPU time of
+# junction-shell and git-upload-archive
+
+measure()
+{
+    local MS=$(best_ms archive "$1")
+
+    echo "$MS ms, $(( MIB * 1000 / MS )) MiB/s, $(best_cpu archive "$1") s CPU"
+}
+
+echo "tar.gz of $MIB MiB, $(nproc) CPUs, best of $ROUNDS:"
+
+if [ "$BASELINE" ]; then
+    echo "  junction-shell of $BASELINE: $(measure "$TMP/ssh-baseline")"
+fi
+
+echo "  junction-shell:                 $(measure "$GIT_SSH_COMMAND")"
+
+# the archive is a standard gzip file of the tar git makes
+
+if [ "$(gunzip -c "$TMP/archive.tar.gz" | sha256sum)" != "$(git --git-dir="$R" archive --format=tar master | sha256sum)" ]; then
+    echo "gunzip does not restore the tar of git archive"
+    exit 1
+fi
+
+echo "gunzip restores the tar of git archive, $(( $(stat -c %s "$TMP/archive.tar.gz") >> 20 )) MiB compressed"
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# CPU time of junction-shell and git-upload-pack for a clone of a
+# repository with large blobs, once with the blobs in the pack and once
+# offloaded to a blob pack that the client downloads over http. Checks
+# that the offloaded clone did download the blob pack and is complete.
+#
+# Needs a build with config::blob_pack_path set to $BLOB_PACKS and
+# config::blob_pack_url to http://127.0.0.1:$PORT, and python3 to serve
+# them. See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+BLOB_PACKS="${BLOB_PACKS:?set BLOB_PACKS to config::blob_pack_path}"
+PORT="${PORT:-8765}"
+BLOBS="${BLOBS:-16}"                    # of 4 MiB each
+
+new_repo blobs blob-packs
+
+R="$BASE/blobs.git"
+
+# large incompressible blobs and a tree of small files
+
+git init --quiet "$TMP/work"
+
+for ((I = 0; I < BLOBS; ++I)); do
+    head -c $((4 << 20)) /dev/urandom > "$TMP/work/blob.$I"
+done
+
+for ((I = 0; I < 500; ++I)); do
+    seq $I $((I + 200)) > "$TMP/work/small.$I"
+done
+
+git -C "$TMP/work" add . \
+    && git -C "$TMP/work" -c user.name=bench -c user.email=bench@localhost commit --quiet -m blobs \
+    && git -C "$TMP/work" push --quiet "$R" HEAD:refs/heads/master \
+    || exit 1
+
+rm -rf "$TMP/work"
+
+# junction-maint packs the blobs and includes the entries
+
+"$JUNCTION/junction-maint" --once > /dev/null
+
+if ! [ -f "$R/junction-blob-packs" ]; then
+    echo "no blob pack entries in $R; is config::blob_pack_path $BLOB_PACKS?"
+    exit 1
+fi
+
+python3 -m http.server "$PORT" --bind 127.0.0.1 --directory "$BLOB_PACKS" > "$TMP/http.log" 2>&1 &
+HTTP=$!
+trap 'kill $HTTP; rm -rf "$TMP"' EXIT
+
+sleep 1
+
+clone()
+{
+    rm -rf "$TMP/clone"
+    git -c protocol.version=2 "$@" clone --quiet --bare ssh://bench/blobs.git "$TMP/clone"
+}
+
+echo "junction-shell + git-upload-pack CPU time of a clone, best of $ROUNDS:"
+echo "  blobs in the pack: $(best_cpu clone) s"
+echo "  blobs offloaded:   $(best_cpu clone -c fetch.uriProtocols=http) s"
+
+# end to end: the client downloaded the blob pack and has every object
+
+: > "$TMP/http.log"
+
+clone -c fetch.uriProtocols=http || exit 1
+
+if ! grep -a -q 'GET /.*pack-[0-9a-f]*\.pack' "$TMP/http.log"; then
+    echo "the client did not download a blob pack"
+    exit 1
+fi
+
+if ! git -C "$TMP/clone" fsck --connectivity-only > /dev/null 2>&1; then
+    echo "the offloaded clone is not complete"
+    exit 1
+fi
+
+echo "offloaded clone downloaded $(grep -a -o 'pack-[0-9a-f]*\.pack' "$TMP/http.log" | head -1) and is complete"
@@ -0,0 +1,117 @@
+#!/bin/bash
+
+# Sourced by the benchmarks in this directory. They run against a scratch
+# build of git-junction whose config.cc points config::base_path,
+# config::run_path, config::cache_path and the other paths to directories
+# of their own, and which has no access map file yet (junction-shell then
+# authorizes by cgitrc). Set BASE to config::base_path:
+#
+#     BASE=/tmp/gj bench/<benchmark>.sh
+#
+# The repositories the benchmarks create are owned by user "bench" and
+# left under BASE for another run.
+
+JUNCTION="${JUNCTION:-$(cd "$(dirname "$0")/.." && pwd)}"
+ROUNDS="${ROUNDS:-5}"
+
+if ! [ "$BASE" ]; then
+    echo "set BASE to config::base_path of the build in $JUNCTION"
+    exit 1
+fi
+
+if ! [ -x "$JUNCTION/junction-shell" ]; then
+    echo "no junction-shell in $JUNCTION, run make first"
+    exit 1
+fi
+
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+# An ssh stand-in for GIT_SSH_COMMAND: runs junction-shell for user bench
+# as sshd would, and appends the CPU time of it and of the git command
+# ("<user> <system>" seconds) to $TMP/cpu.
+
+cat > "$TMP/ssh" <<EOF
+#!/bin/bash
+TIMEFORMAT='%3U %3S'
+{ time GJUSER=bench "$JUNCTION/junction-shell" -c "\${@: -1}" 2>&3 ; } 3>&2 2>>"$TMP/cpu"
+EOF
+chmod +x "$TMP/ssh"
+
+export GIT_SSH_COMMAND="$TMP/ssh"
+export GIT_SSH_VARIANT=ssh                 # passes GIT_PROTOCOL, for protocol v2
+
+# new_repo <name> [<cgitrc word>...]: an empty shared repository
+# ssh://bench/<name>.git, replacing an earlier one
+
+new_repo()
+{
+    local R="$BASE/$1.git"
+    shift
+
+    rm -rf "$R"
+    git init --quiet --bare "$R" || exit 1
+
+    {
+        echo "owner=bench"
+        echo "shared"
+
+        for W in "$@"; do
+            echo "$W"
+        done
+    } > "$R/cgitrc"
+}
+
+# now_ms: wall clock in milliseconds
+
+now_ms()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# best_ms <command>...: the fastest of $ROUNDS runs in milliseconds, the
+# output of the command discarded
+
+best_ms()
+{
+    local BEST=
+    local I
+
+    for ((I = 0; I < ROUNDS; ++I)); do
+        local START=$(now_ms)
+
+        "$@" > /dev/null 2>&1 || { echo "failed: $*" >&2; exit 1; }
+
+        local MS=$(( $(now_ms) - START ))
+
+        if ! [ "$BEST" ] || [ "$MS" -lt "$BEST" ]; then
+            BEST=$MS
+        fi
+    done
+
+    echo "$BEST"
+}
+
+# best_cpu <command>...: the lowest CPU time (user + system, seconds) of
+# junction-shell and its git command in $ROUNDS runs of a command that
+# connects once
+
+best_cpu()
+{
+    local BEST=
+    local I
+
+    for ((I = 0; I < ROUNDS; ++I)); do
+        rm -f "$TMP/cpu"
+
+        "$@" > /dev/null 2>&1 || { echo "failed: $*" >&2; exit 1; }
+
+        local CPU=$(awk '{ s += $1 + $2 } END { printf "%.3f", s }' "$TMP/cpu")
+
+        if ! [ "$BEST" ] || awk "BEGIN { exit !($CPU < $BEST) }"; then
+            BEST=$CPU
+        fi
+    done
+
+    echo "$BEST"
+}
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Connection setup latency: the time from starting junction-shell to
+# git-upload-pack having sent its ref advertisement and exited, averaged
+# over $CONNECTIONS connections. For comparison, git-upload-pack started
+# directly and through git-shell, as junction-shell used to exec it, and
+# optionally the junction-shell of another build (BASELINE=<directory>,
+# configured with the same config::base_path). See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+CONNECTIONS="${CONNECTIONS:-200}"
+
+new_repo exec
+
+git init --quiet "$TMP/work" \
+    && git -C "$TMP/work" -c user.name=bench -c user.email=bench@localhost commit --quiet --allow-empty -m exec \
+    && git -C "$TMP/work" push --quiet "$BASE/exec.git" HEAD:refs/heads/master \
+    || exit 1
+
+# the client's flush: it wants nothing
+
+printf 0000 > "$TMP/flush"
+
+UPLOAD_PACK="$(git --exec-path)/git-upload-pack"
+GIT_SHELL="$(command -v git-shell)"
+
+upload_pack()
+{
+    for ((I = 0; I < CONNECTIONS; ++I)); do
+        "$UPLOAD_PACK" "$BASE/exec.git" < "$TMP/flush" || return 1
+    done
+}
+
+git_shell()
+{
+    for ((I = 0; I < CONNECTIONS; ++I)); do
+        "$GIT_SHELL" -c "git-upload-pack '$BASE/exec.git'" < "$TMP/flush" || return 1
+    done
+}
+
+junction_shell()
+{
+    for ((I = 0; I < CONNECTIONS; ++I)); do
+        GJUSER=bench "$1/junction-shell" -c "git-upload-pack '/exec.git'" < "$TMP/flush" || return 1
+    done
+}
+
+# per_connection <milliseconds>: microseconds per connection
+
+per_connection()
+{
+    echo "$(( $1 * 1000 / CONNECTIONS )) us"
+}
+
+echo "connection setup, mean of $CONNECTIONS, best of $ROUNDS:"
+echo "  git-upload-pack:                $(per_connection "$(best_ms upload_pack)")"
+echo "  git-shell, git-upload-pack:     $(per_connection "$(best_ms git_shell)")"
+
+if [ "$BASELINE" ]; then
+    echo "  junction-shell of $BASELINE: $(per_connection "$(best_ms junction_shell "$BASELINE")")"
+fi
+
+echo "  junction-shell:                 $(per_connection "$(best_ms junction_shell "$JUNCTION")")"
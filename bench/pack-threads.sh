@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# The time junction-shell takes to serve $CLONES (8 by default) clones at
+# once, each sending its pack into a pipe, for comparing a build with
+# config::pack_thread_budget (and pack_window_memory_budget_mib) against
+# one without, passed as BASELINE=<directory> and configured with the same
+# config::base_path. The objects of the repository are loose, as after
+# pushes that junction-maint has not packed yet, so that every clone
+# compresses them and searches for deltas.
+# See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+CLONES="${CLONES:-8}"
+COMMITS="${COMMITS:-300}"
+
+new_repo threads
+
+R="$BASE/threads.git"
+
+# $COMMITS commits, each editing 20 of 200 text files
+
+python3 - "$COMMITS" > "$TMP/history" <<'EOF'
+import random
+import sys
+
+random.seed(1)
+files =[[str(random.getrandbits(64)) for _ in range(600)] for _ in range(200)]
+
+for c in range(int(sys.argv[1])):
+    out =sys.stdout
+    message ='commit %d\n' % c
+    out.write('commit refs/heads/master\n')
+    out.write('committer bench <bench@localhost> %d +0000\n' % (1500000000 + c))
+    out.write('data %d\n%s' % (len(message), message))
+
+    for f in random.sample(range(200), 20):
+        lines =files[f]
+        for _ in range(10):
+            lines[random.randrange(len(lines))] =str(random.getrandbits(64))
+        data ='\n'.join(lines) + '\n'
+        out.write('M 100644 inline file.%d\ndata %d\n%s\n' % (f, len(data), data))
+EOF
+
+git init --quiet --bare "$TMP/import.git" \
+    && git --git-dir="$TMP/import.git" fast-import --quiet < "$TMP/history" \
+    && git --git-dir="$R" unpack-objects -q < "$(ls "$TMP"/import.git/objects/pack/*.pack)" \
+    && git --git-dir="$R" update-ref refs/heads/master "$(git --git-dir="$TMP/import.git" rev-parse master)" \
+    || exit 1
+
+# the fetch request of a clone, and the sink standing in for sshd
+
+printf '0032want %s\n00000009done\n' "$(git --git-dir="$R" rev-parse master)" > "$TMP/request"
+
+clones()
+{
+    local I
+
+    for ((I = 0; I < CLONES; ++I)); do
+        GJUSER=bench "$1/junction-shell" -c "git-upload-pack '/threads.git'" < "$TMP/request" 2> /dev/null | cat > /dev/null &
+    done
+
+    wait
+}
+
+echo "$CLONES concurrent clones of $(git --git-dir="$R" count-objects | cut -d" " -f1) objects, $(nproc) CPUs, best of $ROUNDS:"
+
+if [ "$BASELINE" ]; then
+    echo "  junction-shell of $BASELINE: $(best_ms clones "$BASELINE") ms"
+fi
+
+echo "  junction-shell:                 $(best_ms clones "$JUNCTION") ms"
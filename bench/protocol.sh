@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Fetch negotiation time through junction-shell on a repository with
+# $REFS refs (100000 by default): an up-to-date clone fetching one
+# branch, and ls-remote --heads, with protocol v0 and v2. Protocol v0
+# advertises every ref, v2 only those the client asks for. See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+REFS="${REFS:-100000}"
+
+new_repo protocol
+
+R="$BASE/protocol.git"
+
+git init --quiet "$TMP/work" \
+    && git -C "$TMP/work" -c user.name=bench -c user.email=bench@localhost commit --quiet --allow-empty -m protocol \
+    && git -C "$TMP/work" push --quiet "$R" HEAD:refs/heads/master \
+    || exit 1
+
+OID="$(git -C "$TMP/work" rev-parse HEAD)"
+
+awk -v oid="$OID" -v n="$REFS" 'BEGIN { for (i = 0; i < n; ++i) printf "create refs/tags/t%06d %s\n", i, oid }' \
+    | git --git-dir="$R" update-ref --stdin \
+    && git --git-dir="$R" pack-refs --all \
+    || exit 1
+
+git -C "$TMP/work" remote add origin ssh://bench/protocol.git || exit 1
+
+fetch()
+{
+    git -C "$TMP/work" -c protocol.version=$1 fetch --quiet --no-tags origin master
+}
+
+ls_remote()
+{
+    git -c protocol.version=$1 ls-remote --heads ssh://bench/protocol.git
+}
+
+echo "$REFS refs, best of $ROUNDS:"
+
+for V in 0 2; do
+    echo "  protocol v$V: fetch of one branch $(best_ms fetch $V) ms, ls-remote --heads $(best_ms ls_remote $V) ms"
+done
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Push and ref advertisement latency through junction-shell on a
+# repository with $REFS refs (200000 by default), with the files backend
+# (packed-refs) and after junction-maint has migrated it to reftable (the
+# word "reftable" in cgitrc). The migration needs git 2.46 or later.
+# See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+REFS="${REFS:-200000}"
+
+new_repo refs reftable
+
+R="$BASE/refs.git"
+
+git init --quiet "$TMP/work" \
+    && git -C "$TMP/work" -c user.name=bench -c user.email=bench@localhost commit --quiet --allow-empty -m refs \
+    && git -C "$TMP/work" push --quiet "$R" HEAD:refs/heads/master \
+    || exit 1
+
+OID="$(git -C "$TMP/work" rev-parse HEAD)"
+
+awk -v oid="$OID" -v n="$REFS" 'BEGIN { for (i = 0; i < n; ++i) printf "create refs/tags/t%06d %s\n", i, oid }' \
+    | git --git-dir="$R" update-ref --stdin \
+    && git --git-dir="$R" pack-refs --all \
+    || exit 1
+
+PUSHES=0
+
+push()
+{
+    PUSHES=$((PUSHES + 1))
+    git -C "$TMP/work" push --quiet ssh://bench/refs.git "HEAD:refs/heads/bench-$PUSHES"
+}
+
+ls_remote()
+{
+    git ls-remote ssh://bench/refs.git
+}
+
+measure()
+{
+    echo "$1, $(git --git-dir="$R" for-each-ref | wc -l) refs, best of $ROUNDS:"
+    echo "  push of a new branch: $(best_ms push) ms"
+    echo "  ls-remote:            $(best_ms ls_remote) ms"
+}
+
+measure "files backend"
+
+if ! git init --quiet --bare --ref-format=reftable "$TMP/probe.git" > /dev/null 2>&1; then
+    echo "$(git version) has no reftable backend, 2.46 or later is needed"
+    exit 1
+fi
+
+"$JUNCTION/junction-maint" --once > /dev/null
+
+if [ "$(git --git-dir="$R" rev-parse --show-ref-format)" != reftable ]; then
+    echo "junction-maint did not migrate $R"
+    exit 1
+fi
+
+measure "reftable backend"
@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# The time junction-shell and git-upload-pack take to send the pack of a
+# clone of a repository with $MIB MiB (1024 by default) of incompressible
+# blobs, and their CPU time, for comparing the relay mode
+# (config::relay_transfers) with git exec'd directly: build one tree with
+# relay_transfers =1 and another without, both with the same
+# config::base_path, and pass the other one as BASELINE=<directory>.
+# See common.sh.
+
+. "$(dirname "$0")/common.sh"
+
+MIB="${MIB:-1024}"
+
+new_repo relay
+
+R="$BASE/relay.git"
+
+# incompressible blobs in one pack, above core.bigFileThreshold so that
+# nothing tries to delta them
+
+git init --quiet "$TMP/work"
+
+for ((I = 0; I < MIB / 16; ++I)); do
+    head -c $((16 << 20)) /dev/urandom > "$TMP/work/blob.$I"
+done
+
+git -C "$TMP/work" -c core.bigFileThreshold=1m add . \
+    && git -C "$TMP/work" -c user.name=bench -c user.email=bench@localhost commit --quiet -m relay \
+    && git -C "$TMP/work" -c core.bigFileThreshold=1m push --quiet "$R" HEAD:refs/heads/master \
+    && git --git-dir="$R" -c core.bigFileThreshold=1m repack -a -d -q \
+    || exit 1
+
+rm -rf "$TMP/work"
+
+# the fetch request of a clone, and the sink standing in for sshd
+
+printf '0032want %s\n00000009done\n' "$(git --git-dir="$R" rev-parse master)" > "$TMP/request"
+
+serve()
+{
+    GJUSER=bench "$1/junction-shell" -c "git-upload-pack '/relay.git'" < "$TMP/request" 2> /dev/null | cat > /dev/null
+}
+
+# the rounds alternate between the builds, so that both see the same load
+
+BUILDS=("$JUNCTION")
+
+if [ "$BASELINE" ]; then
+    BUILDS=("$BASELINE" "$JUNCTION")
+fi
+
+declare -A BEST_MS BEST_CPU
+
+TIMEFORMAT='%3R %3U %3S'
+
+for ((I = 0; I < ROUNDS; ++I)); do
+    for B in "${BUILDS[@]}"; do
+        T=($( { time serve "$B" ; } 2>&1 ))
+
+        MS=$(awk "BEGIN { printf \"%d\", ${T[0]} * 1000 }")
+        CPU=$(awk "BEGIN { printf \"%.3f\", ${T[1]} + ${T[2]} }")
+
+        if ! [ "${BEST_MS[$B]}" ] || [ "$MS" -lt "${BEST_MS[$B]}" ]; then
+            BEST_MS[$B]=$MS
+        fi
+
+        if ! [ "${BEST_CPU[$B]}" ] || awk "BEGIN { exit !($CPU < ${BEST_CPU[$B]}) }"; then
+            BEST_CPU[$B]=$CPU
+        fi
+    done
+done
+
+PACK=$(du -m -c "$R"/objects/pack/*.pack | tail -1 | cut -f1)
+
+echo "serving a clone of $PACK MiB, best of $ROUNDS:"
+
+for B in "${BUILDS[@]}"; do
+    printf '  junction-shell of %s: %d ms, %d MiB/s, %s s CPU\n' \
+           "$B" "${BEST_MS[$B]}" $(( PACK * 1000 / BEST_MS[$B] )) "${BEST_CPU[$B]}"
+done
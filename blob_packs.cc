@@ -0,0 +1,458 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "blob_packs.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "process_io.hh"
+#include "utils.hh"
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
+
+//
+
+namespace
+{
+    static const char include_file[] ="junction-blob-packs";
+    static const char object_dir[]   ="junction-blob-objects";
+
+    // the repository's place under config::blob_pack_path and
+    // config::blob_pack_url
+
+    static std::string relative_path(const std::string &path)
+    {
+        if (path.compare(0, config::base_path.size(), config::base_path) == 0)
+            return path.substr(config::base_path.size());
+
+        return '/' + path;
+    }
+
+    static void git_command(std::ostringstream &command_oss, const std::string &path)
+    {
+        escape_bash escape{command_oss};
+
+        command_oss << "git --git-dir=";
+        escape << path;
+        command_oss << ' ';
+    }
+
+    static bool run(const std::string &command)
+    {
+        const int status =system(command.c_str());
+
+        return status != -1
+            && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+    }
+
+    // blobs of at least config::blob_pack_min_kib reachable from any ref
+
+    static std::vector<std::string> large_blobs(const std::string &path)
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "rev-list --objects --all --filter=blob:limit=" << config::blob_pack_min_kib << "k"
+            " --filter-print-omitted | sed -n 's/^~//p'";
+
+        process_io process{command_oss.str()};
+        process.close_write();
+
+        std::vector<std::string> blobs;
+        std::string line;
+
+        while (getline(process.read(), line))
+            blobs.push_back(line);
+
+        return blobs;
+    }
+
+    typedef std::map<std::string, std::string> entries_t;      // pack by blob
+
+    static entries_t read_entries(const std::string &path)
+    {
+        std::ifstream ifs{path + '/' + include_file};
+        entries_t entries;
+        std::string line;
+
+        while (getline(ifs, line))
+        {
+            std::istringstream iss{line};
+            std::string key, equals, blob, hash;
+
+            if (iss >> key >> equals >> blob >> hash
+                && key == "blobPackfileUri")
+            {
+                entries[blob] =hash;
+            }
+        }
+
+        return entries;
+    }
+
+    // a pack of one blob, as git-upload-pack sends a URI per blob and the
+    // client downloads each; returns the name (hash) of the pack
+
+    static std::string write_pack(const std::string &path, const std::string &dir, const std::string &blob)
+    {
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        command_oss << "mkdir -p ";
+        escape << dir;
+        command_oss << " && ";
+        git_command(command_oss, path);
+        command_oss << "pack-objects --quiet ";
+        escape << dir + "/pack";
+
+        process_io process{command_oss.str()};
+
+        process.write() << blob << '\n';
+        process.close_write();
+
+        std::string hash;
+
+        if (!getline(process.read(), hash)
+            || hash.empty())
+        {
+            throw generic_exception{"pack-objects failed (" + path + ")"};
+        }
+
+        return hash;
+    }
+
+    static void write_entries(const std::string &path, const entries_t &entries)
+    {
+        const std::string file =path + '/' + include_file;
+
+        std::ostringstream tmp_oss;
+        tmp_oss << file << ".tmp." << getpid();
+
+        const std::string tmp_file =tmp_oss.str();
+
+        {
+            std::ofstream ofs{tmp_file};
+
+            // git-upload-pack sends packfile URIs only to clients that
+            // asked for sideband-all, which it doesn't offer by default
+
+            ofs << "# written by git-junction, see blob_packs.hh\n"
+                "[uploadpack]\n"
+                "\tallowSidebandAll = true\n";
+
+            for (auto ptr =entries.begin();
+                 ptr != entries.end();
+                 ++ptr)
+            {
+                ofs << "\tblobPackfileUri = " << ptr->first << ' ' << ptr->second << ' '
+                    << config::blob_pack_url << relative_path(path) << "/pack-" << ptr->second << ".pack\n";
+            }
+
+            if (!ofs.flush()) {
+                unlink(tmp_file.c_str());
+                throw generic_exception{"blob pack entries export failed (" + tmp_file + ")"};
+            }
+        }
+
+        if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+            const int error =errno;
+            unlink(tmp_file.c_str());
+            throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", error};
+        }
+    }
+
+    // *****
+
+    // git-pack-objects leaves out a blob with an entry only when it doesn't
+    // find it in a pack. The repository keeps its large blobs as loose
+    // objects in object_dir, which it borrows from, and repacks with -l
+    // (as junction-maint and git gc do) so that its own packs don't have
+    // them.
+
+    static bool has_loose(const std::string &path, const std::string &blob)
+    {
+        const std::string file =path + '/' + object_dir + '/' + blob.substr(0, 2) + '/' + blob.substr(2);
+
+        return access(file.c_str(), F_OK) == 0;
+    }
+
+    static void write_loose(const std::string &path, const std::string &blob)
+    {
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        command_oss << "mkdir -p ";
+        escape << path + '/' + object_dir;
+        command_oss << " && ";
+        git_command(command_oss, path);
+        command_oss << "cat-file blob " << blob << " | GIT_OBJECT_DIRECTORY=";
+        escape << path + '/' + object_dir;
+        command_oss << " GIT_ALTERNATE_OBJECT_DIRECTORIES= ";
+        git_command(command_oss, path);
+        command_oss << "hash-object -w --stdin --no-filters";
+
+        process_io process{command_oss.str()};
+        process.close_write();
+
+        std::string hash;
+
+        if (!getline(process.read(), hash)
+            || hash != blob)
+        {
+            throw generic_exception{"failed to write blob " + blob + " of " + path};
+        }
+    }
+
+    static bool linked(const std::string &path)
+    {
+        std::ifstream ifs{path + "/objects/info/alternates"};
+        std::string line;
+
+        while (getline(ifs, line))
+        {
+            if (line == path + '/' + object_dir)
+                return true;
+        }
+
+        return false;
+    }
+
+    static void link(const std::string &path)
+    {
+        const std::string file =path + "/objects/info/alternates";
+
+        std::ofstream ofs{file, std::ios::app};
+
+        ofs << path << '/' << object_dir << '\n';
+
+        if (!ofs.flush())
+            throw generic_exception{"failed to write " + file};
+    }
+
+    static void unlink_objects(const std::string &path)
+    {
+        const std::string file =path + "/objects/info/alternates";
+        std::ostringstream rest;
+
+        {
+            std::ifstream ifs{file};
+            std::string line;
+
+            while (getline(ifs, line))
+            {
+                if (line != path + '/' + object_dir)
+                    rest << line << '\n';
+            }
+        }
+
+        if (rest.str().empty()) {
+            if (unlink(file.c_str()) != 0)
+                throw stdlib_exception{"unlink(" + file + ")", errno};
+
+            return;
+        }
+
+        const std::string tmp_file =file + ".tmp";
+
+        {
+            std::ofstream ofs{tmp_file};
+            ofs << rest.str();
+
+            if (!ofs.flush())
+                throw generic_exception{"failed to write " + tmp_file};
+        }
+
+        if (rename(tmp_file.c_str(), file.c_str()) != 0)
+            throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", errno};
+    }
+
+    // *****
+
+    // drops the packs the entries stopped referring to long enough ago
+
+    static void drop_old_packs(const std::string &dir, const entries_t &entries)
+    {
+        std::set<std::string> hashes;
+
+        for (auto ptr =entries.begin();
+             ptr != entries.end();
+             ++ptr)
+        {
+            hashes.insert(ptr->second);
+        }
+
+        const time_t expired =time(nullptr) - config::blob_pack_grace_minutes * 60;
+
+        opendir_raii d{dir};
+        struct dirent *dirent;
+
+        while ((dirent =d.readdir()))
+        {
+            const std::string name =dirent->d_name;
+
+            if (name.compare(0, 5, "pack-") != 0
+                || hashes.count(name.substr(5, name.find('.') - 5)) != 0)
+            {
+                continue;
+            }
+
+            const std::string file =dir + '/' + name;
+            struct stat st;
+
+            if (stat(file.c_str(), &st) != 0)
+                throw stdlib_exception{"stat(" + file + ")", errno};
+
+            if (st.st_mtime < expired
+                && unlink(file.c_str()) != 0)
+            {
+                throw stdlib_exception{"unlink(" + file + ")", errno};
+            }
+        }
+    }
+}
+
+// *********************************************************
+
+unsigned int blob_packs::update(const std::string &path)
+{
+    if (config::blob_pack_path.empty())
+        throw generic_exception{"config::blob_pack_path is not set"};
+
+    const std::vector<std::string> blobs =large_blobs(path);
+
+    if (blobs.empty()) {
+        remove(path);
+        return 0;
+    }
+
+    const std::string dir =config::blob_pack_path + relative_path(path);
+
+    const entries_t listed =read_entries(path);
+    entries_t entries;
+
+    bool repack =false;
+
+    for (auto blob =blobs.begin();
+         blob != blobs.end();
+         ++blob)
+    {
+        const auto ptr =listed.find(*blob);
+
+        if (ptr != listed.end()
+            && access((dir + "/pack-" + ptr->second + ".pack").c_str(), F_OK) == 0)
+        {
+            entries.insert(*ptr);
+        }
+        else
+            entries[*blob] =write_pack(path, dir, *blob);
+
+        if (!has_loose(path, *blob)) {
+            write_loose(path, *blob);
+            repack =true;
+        }
+    }
+
+    if (!linked(path)) {
+        link(path);
+        repack =true;
+    }
+
+    if (repack)
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "repack -a -d -l -q";
+
+        if (!run(command_oss.str()))
+            throw generic_exception{"failed to repack " + path + " without its large blobs"};
+    }
+
+    if (entries != listed)
+    {
+        write_entries(path, entries);
+
+        // include the entries, once
+
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "config --replace-all include.path " << include_file << " '^" << include_file << "$'";
+
+        if (!run(command_oss.str()))
+            throw generic_exception{"failed to include the blob pack entries of " + path};
+
+        // the grace period of the packs they stopped referring to starts now
+
+        for (auto ptr =listed.begin();
+             ptr != listed.end();
+             ++ptr)
+        {
+            const auto entry =entries.find(ptr->first);
+
+            if (entry == entries.end()
+                || entry->second != ptr->second)
+            {
+                utime((dir + "/pack-" + ptr->second + ".pack").c_str(), nullptr);
+                utime((dir + "/pack-" + ptr->second + ".idx").c_str(), nullptr);
+            }
+        }
+    }
+
+    drop_old_packs(dir, entries);
+
+    return blobs.size();
+}
+
+void blob_packs::remove(const std::string &path)
+{
+    // the repository takes its large blobs back before it stops borrowing
+    // them
+
+    if (linked(path))
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "repack -a -d -q";
+
+        if (!run(command_oss.str()))
+            throw generic_exception{"failed to repack " + path + " with its large blobs"};
+
+        unlink_objects(path);
+    }
+
+    std::ostringstream command_oss;
+    escape_bash escape{command_oss};
+
+    git_command(command_oss, path);
+    command_oss << "config --unset-all include.path '^" << include_file << "$'"
+        "; rm -f ";
+    escape << path + '/' + include_file;
+    command_oss << "; rm -rf ";
+    escape << path + '/' + object_dir;
+
+    if (!config::blob_pack_path.empty()) {
+        command_oss << "; rm -rf ";
+        escape << config::blob_pack_path + relative_path(path);
+    }
+
+    system(command_oss.str().c_str());
+}
@@ -0,0 +1,40 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_BLOB_PACKS_HEADER
+#define GIT_JUNCTION_BLOB_PACKS_HEADER
+
+#include <string>
+
+// Offloads the large blobs of a repository (config::blob_pack_min_kib and
+// up) to packs of one blob each under config::blob_pack_path, which a web
+// server serves statically at config::blob_pack_url. git-upload-pack is
+// told about them with one uploadpack.blobPackfileUri per blob; protocol
+// v2 clients with fetch.uriProtocols set then download the packs over
+// HTTP(S) and git-upload-pack leaves those blobs out of the pack it
+// streams. It does so only for objects it doesn't find in a pack, so the
+// repository keeps the large blobs as loose objects in
+// <repository>/junction-blob-objects, an alternate of its own, and out of
+// its packs. Repositories in an object pool (see object_pools.hh) find
+// them in the pool's pack and send them as usual.
+//
+// The entries are kept in <repository>/junction-blob-packs, which the
+// repository's config includes, so that they can be replaced at once.
+// Blobs pushed after update() are sent the usual way until it is run
+// again, which junction-maint does whenever it maintains the repository.
+// A pack that lost its entry stays for config::blob_pack_grace_minutes,
+// as clients that got the old entries may still be downloading it.
+
+class blob_packs {
+public:
+    // writes packs and entries for new large blobs, and removes packs
+    // dropped long enough ago; returns the number of blobs offloaded
+    static unsigned int update(const std::string &path);
+
+    static void remove(const std::string &path);
+};
+
+#endif
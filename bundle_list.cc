@@ -0,0 +1,334 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "bundle_list.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "process_io.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    static const char include_file[] ="junction-bundles";
+
+    // the repository's place under config::bundle_path and
+    // config::bundle_url
+
+    static std::string relative_path(const std::string &path)
+    {
+        if (path.compare(0, config::base_path.size(), config::base_path) == 0)
+            return path.substr(config::base_path.size());
+
+        return '/' + path;
+    }
+
+    static void git_command(std::ostringstream &command_oss, const std::string &path)
+    {
+        escape_bash escape{command_oss};
+
+        command_oss << "git --git-dir=";
+        escape << path;
+        command_oss << ' ';
+    }
+
+    static std::string bundle_name(unsigned long long token)
+    {
+        std::ostringstream oss;
+        oss << token << ".bundle";
+        return oss.str();
+    }
+
+    // creationTokens of the listed bundles, oldest first
+
+    static std::vector<unsigned long long> listed_bundles(const std::string &dir)
+    {
+        std::vector<unsigned long long> tokens;
+        struct stat st;
+
+        if (stat(dir.c_str(), &st) != 0) {
+            if (errno == ENOENT)
+                return tokens;
+            throw stdlib_exception{"stat(" + dir + ")", errno};
+        }
+
+        opendir_raii d{dir};
+        struct dirent *dirent;
+
+        while ((dirent =d.readdir()))
+        {
+            if (dirent->d_name[0] < '0'
+                || dirent->d_name[0] > '9')
+            {
+                continue;
+            }
+
+            char *end;
+            const unsigned long long token =strtoull(dirent->d_name, &end, 10);
+
+            if (strcmp(end, ".bundle") == 0)
+                tokens.push_back(token);
+        }
+
+        std::sort(tokens.begin(), tokens.end());
+
+        return tokens;
+    }
+
+    // the tips of the listed bundles; everything reachable from them is in
+    // some bundle already
+
+    static std::set<std::string> bundled_tips(const std::string &dir, const std::vector<unsigned long long> &tokens)
+    {
+        std::set<std::string> tips;
+
+        for (auto ptr =tokens.begin();
+             ptr != tokens.end();
+             ++ptr)
+        {
+            std::ostringstream command_oss;
+            escape_bash escape{command_oss};
+
+            command_oss << "git bundle list-heads ";
+            escape << dir + '/' + bundle_name(*ptr);
+
+            process_io process{command_oss.str()};
+            process.close_write();
+
+            std::string line;
+
+            while (getline(process.read(), line))
+                tips.insert(line.substr(0, line.find(' ')));
+        }
+
+        return tips;
+    }
+
+    static std::vector<std::string> ref_names(const std::string &path)
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "for-each-ref --format='%(refname)' refs/heads refs/tags";
+
+        process_io process{command_oss.str()};
+        process.close_write();
+
+        std::vector<std::string> refs;
+        std::string line;
+
+        while (getline(process.read(), line))
+            refs.push_back(line);
+
+        return refs;
+    }
+
+    // runs 'command' with the refs, less the given tips, on its stdin; returns
+    // the first line of its output
+
+    static std::string run_with_revisions(const std::string &command,
+                                          const std::vector<std::string> &refs,
+                                          const std::set<std::string> &tips)
+    {
+        process_io process{command};
+
+        for (auto ptr =refs.begin();
+             ptr != refs.end();
+             ++ptr)
+        {
+            process.write() << *ptr << '\n';
+        }
+
+        for (auto ptr =tips.begin();
+             ptr != tips.end();
+             ++ptr)
+        {
+            process.write() << '^' << *ptr << '\n';
+        }
+
+        process.close_write();
+
+        std::string line;
+        getline(process.read(), line);
+
+        return line;
+    }
+
+    static void write_entries(const std::string &path, const std::vector<unsigned long long> &tokens)
+    {
+        const std::string url =config::bundle_url + relative_path(path) + '/';
+        const std::string file =path + '/' + include_file;
+
+        std::ostringstream tmp_oss;
+        tmp_oss << file << ".tmp." << getpid();
+
+        const std::string tmp_file =tmp_oss.str();
+
+        {
+            std::ofstream ofs{tmp_file};
+
+            ofs << "# written by junction-bundles, see bundle_list.hh\n"
+                "[uploadpack]\n"
+                "\tadvertiseBundleURIs = true\n"
+                "[bundle]\n"
+                "\tversion = 1\n"
+                "\tmode = all\n"
+                "\theuristic = creationToken\n";
+
+            for (auto ptr =tokens.begin();
+                 ptr != tokens.end();
+                 ++ptr)
+            {
+                ofs << "[bundle \"" << *ptr << "\"]\n"
+                    "\turi = " << url << bundle_name(*ptr) << "\n"
+                    "\tcreationToken = " << *ptr << '\n';
+            }
+
+            if (!ofs.flush()) {
+                unlink(tmp_file.c_str());
+                throw generic_exception{"bundle list export failed (" + tmp_file + ")"};
+            }
+        }
+
+        if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+            const int error =errno;
+            unlink(tmp_file.c_str());
+            throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", error};
+        }
+    }
+}
+
+// *********************************************************
+
+bool bundle_list::update(const std::string &path)
+{
+    if (config::bundle_path.empty())
+        throw generic_exception{"config::bundle_path is not set"};
+
+    const std::vector<std::string> refs =ref_names(path);
+
+    if (refs.empty()) {
+        remove(path);
+        return false;
+    }
+
+    const std::string dir =config::bundle_path + relative_path(path);
+
+    std::vector<unsigned long long> tokens =listed_bundles(dir);
+    std::set<std::string> tips =bundled_tips(dir, tokens);
+
+    bool rebuild =tokens.size() >= config::bundle_max_count;
+
+    if (!tokens.empty())
+    {
+        // commits not in any bundle yet; no answer means that a bundled tip
+        // has been pruned since
+
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "rev-list --count --stdin 2>/dev/null";
+
+        const std::string count =run_with_revisions(command_oss.str(), refs, tips);
+
+        if (count == "0")
+            return false;
+        if (count.empty())
+            rebuild =true;
+    }
+
+    if (rebuild)
+        tips.clear();
+
+    // creationTokens must grow, also when the clock does not
+
+    unsigned long long token =time(nullptr);
+
+    if (!tokens.empty()
+        && token <= tokens.back())
+    {
+        token =tokens.back() + 1;
+    }
+
+    {
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        command_oss << "mkdir -p ";
+        escape << dir;
+        command_oss << " && ";
+        git_command(command_oss, path);
+        command_oss << "bundle create --quiet ";
+        escape << dir + '/' + bundle_name(token);
+        command_oss << " --stdin && echo ok";
+
+        if (run_with_revisions(command_oss.str(), refs, tips) != "ok")
+            throw generic_exception{"git bundle create failed (" + path + ")"};
+    }
+
+    std::vector<unsigned long long> stale;
+
+    if (rebuild)
+        stale.swap(tokens);
+
+    tokens.push_back(token);
+
+    write_entries(path, tokens);
+
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "config --replace-all include.path " << include_file << " '^" << include_file << "$'";
+
+        system(command_oss.str().c_str());
+    }
+
+    // clients still downloading these were given the old list; they fall
+    // back to fetching
+
+    for (auto ptr =stale.begin();
+         ptr != stale.end();
+         ++ptr)
+    {
+        unlink((dir + '/' + bundle_name(*ptr)).c_str());
+    }
+
+    return true;
+}
+
+void bundle_list::remove(const std::string &path)
+{
+    std::ostringstream command_oss;
+    escape_bash escape{command_oss};
+
+    git_command(command_oss, path);
+    command_oss << "config --unset-all include.path '^" << include_file << "$'"
+        "; rm -f ";
+    escape << path + '/' + include_file;
+
+    if (!config::bundle_path.empty()) {
+        command_oss << "; rm -rf ";
+        escape << config::bundle_path + relative_path(path);
+    }
+
+    system(command_oss.str().c_str());
+}
@@ -0,0 +1,35 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_BUNDLE_LIST_HEADER
+#define GIT_JUNCTION_BUNDLE_LIST_HEADER
+
+#include <string>
+
+// Keeps a list of git bundles of a repository under config::bundle_path,
+// which a web server serves statically at config::bundle_url, and
+// advertises it to protocol v2 clients through bundle-uri (git 2.40 or
+// later on the server). Cloning clients download the bundles first and
+// fetch only what is newer from git-upload-pack.
+//
+// The list grows incrementally: update() adds a bundle of the branches
+// and tags not reachable from the bundles already listed, named and
+// ordered by its creationToken. Once config::bundle_max_count bundles
+// are listed, or a listed tip has been pruned, the list is rebuilt as a
+// single bundle of everything.
+//
+// The bundle.* entries are kept in <repository>/junction-bundles, which
+// the repository's config includes, so that they can be replaced at once.
+
+class bundle_list {
+public:
+    // returns true when a bundle was added
+    static bool update(const std::string &path);
+
+    static void remove(const std::string &path);
+};
+
+#endif
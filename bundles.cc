@@ -0,0 +1,82 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "bundle_list.hh"
+#include "cgitrc.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "utils.hh"
+
+#include <iostream>
+#include <string>
+
+// Adds a bundle to the bundle list of every repository with the cgitrc
+// word "bundle-uris" that has new commits, see bundle_list.hh. Meant to be
+// run periodically, e.g. from cron, as the user owning the repositories.
+
+namespace
+{
+    class updater : public git_dir_functor {
+        bool &failed;
+    public:
+        updater(bool &f)
+            : failed(f) {}
+
+        virtual void operator() (const std::string &path) const
+        {
+            try {
+                const cgitrc rc =cgitrc::import_from_file(path + "/cgitrc");
+
+                if (rc.flag(cgitrc::f_bundle_uris))
+                    bundle_list::update(path);
+            }
+            catch (import_exception) {
+            }
+            catch (generic_exception &e) {
+                std::cerr << "junction-bundles: " << path << ": " << e << "\n";
+                failed =true;
+            }
+            catch (stdlib_exception &e) {
+                std::cerr << "junction-bundles: " << path << ": " << e << "\n";
+                failed =true;
+            }
+        }
+    };
+}
+
+// *********************************************************
+
+int main(int argc, char *[])
+{
+    enum {
+        return_ok =0,
+        return_usage_error,
+        return_stdlib_error,
+        return_generic_error,
+    };
+
+    if (argc > 1) {
+        std::cerr << "usage: junction-bundles\n";
+        return return_usage_error;
+    }
+
+    if (config::bundle_path.empty()) {
+        std::cerr << "junction-bundles: config::bundle_path is not set\n";
+        return return_usage_error;
+    }
+
+    bool failed =false;
+
+    try {
+        for_each_git_dir(updater(failed));
+    }
+    catch (stdlib_exception &e) {
+        std::cerr << "junction-bundles: " << e << "\n";
+        return return_stdlib_error;
+    }
+
+    return failed ? return_generic_error : return_ok;
+}
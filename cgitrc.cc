@@ -6,10 +6,26 @@
 
 #include "cgitrc.hh"
 #include "exception.hh"
+#include "probes.hh"
 
 #include <ostream>
 #include <fstream>
 
+bool cgitrc::flag(flags_t f) const
+{
+    return flags & (1u << f);
+}
+
+void cgitrc::set_flag(flags_t f)
+{
+    flags |= (1u << f);
+}
+
+void cgitrc::clear_flag(flags_t f)
+{
+    flags &= ~(1u << f);
+}
+
 void cgitrc::export_to_file(const std::string &file)
 {
     std::ofstream ofs{file};
@@ -28,10 +44,14 @@ cgitrc cgitrc::new_instance(const std::string &o, repo_type t)
 
 cgitrc cgitrc::import_from_file(const std::string &file)
 {
+    const probe_timer timer;
+
     std::ifstream ifs{file};
 
-    if (!ifs)
+    if (!ifs) {
+        PROBE3(cgitrc_import, file.c_str(), 0, timer.elapsed());
         throw import_exception{};
+    }
 
     cgitrc rc;
     std::string line;
@@ -47,15 +67,41 @@ cgitrc cgitrc::import_from_file(const std::string &file)
             rc.owner =line.substr(6);
         else if (line.compare(0, 5, "desc=") == 0)
             rc.desc =line.substr(5);
+        else if (line.compare(0, 8, "profile=") == 0)
+            rc.profile =line.substr(8);
         else if (line == "mirrored")
             rc.type =repo_type::mirrored;
         else if (line == "shared")
             rc.type =repo_type::shared;
+        else {
+            for (unsigned int f =0; f < flag_count; ++f)
+            {
+                if (line == flag_name(static_cast<flags_t>(f)))
+                    rc.set_flag(static_cast<flags_t>(f));
+            }
+        }
     }
 
+    PROBE3(cgitrc_import, file.c_str(), 1, timer.elapsed());
+
     return rc;
 }
 
+const char *cgitrc::flag_name(flags_t f)
+{
+    switch (f) {
+    case f_upload_pack_cache: return "upload-pack-cache";
+    case f_coalesce_fetches:  return "coalesce-fetches";
+    case f_blob_packs:        return "blob-packs";
+    case f_bundle_uris:       return "bundle-uris";
+    case f_reftable:          return "reftable";
+        //
+    case flag_count: break;
+    }
+
+    return "";
+}
+
 // *********************************************************
 
 std::ostream &operator<< (std::ostream &out, const cgitrc &rc)
@@ -67,6 +113,8 @@ std::ostream &operator<< (std::ostream &out, const cgitrc &rc)
         out << "owner=" << rc.owner << '\n';
     if (!rc.desc.empty())
         out << "desc=" << rc.desc << '\n';
+    if (!rc.profile.empty())
+        out << "profile=" << rc.profile << '\n';
 
     switch (rc.type) {
     case repo_type::shared:   out << "shared\n"; break;
@@ -75,5 +123,11 @@ std::ostream &operator<< (std::ostream &out, const cgitrc &rc)
     case repo_type::unknown: break;
     }
 
+    for (unsigned int f =0; f < cgitrc::flag_count; ++f)
+    {
+        if (rc.flag(static_cast<cgitrc::flags_t>(f)))
+            out << cgitrc::flag_name(static_cast<cgitrc::flags_t>(f)) << '\n';
+    }
+
     return out;
 }
@@ -18,15 +18,28 @@ public:
         mirrored,
     };
 
+    // junction options, stored as bare words like the repository type
+    enum flags_t {
+        f_upload_pack_cache,
+        f_coalesce_fetches,
+        f_blob_packs,
+        f_bundle_uris,
+        f_reftable,
+        //
+        flag_count
+    };
+
 private:
     std::string owner;
     std::string desc;
+    std::string profile;    // see config::repository_profiles
     repo_type type;
+    unsigned int flags;
 
     cgitrc()
-        : type{repo_type::unknown} {}
+        : type{repo_type::unknown}, flags{0} {}
     cgitrc(const std::string &o, repo_type t)
-        : owner{o}, type{t} {}
+        : owner{o}, type{t}, flags{0} {}
 
 public:
     cgitrc(const cgitrc &) =default;
@@ -36,9 +49,16 @@ public:
 
     const std::string &get_owner() const { return owner; }
     const std::string &get_desc() const { return desc; }
+    const std::string &get_profile() const { return profile; }
     repo_type          get_type() const { return type; }
+    unsigned int       get_flags() const { return flags; }
+
+    bool flag(flags_t) const;
 
     void set_desc(const std::string &d) { desc =d; }
+    void set_profile(const std::string &p) { profile =p; }
+    void set_flag(flags_t);
+    void clear_flag(flags_t);
 
     void export_to_file(const std::string &file);
 
@@ -47,6 +67,8 @@ public:
     static cgitrc new_instance(const std::string &owner_, repo_type);
     static cgitrc import_from_file(const std::string &file);
 
+    static const char *flag_name(flags_t);
+
     //
     friend std::ostream &operator<< (std::ostream &, const cgitrc &);
 };
@@ -0,0 +1,166 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "cgroup.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    static bool write_file(const std::string &file, const char *data)
+    {
+        const int fd =open(file.c_str(), O_WRONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            return false;
+
+        const size_t size =strlen(data);
+        const bool result =(write(fd, data, size) == static_cast<ssize_t>(size));
+
+        close(fd);
+        return result;
+    }
+
+    // the controllers must be enabled on the way down, one by one: the
+    // kernel rejects a whole write if one of them isn't available or
+    // delegated. Enabling one that already is succeeds.
+
+    static void enable_controllers(const std::string &dir)
+    {
+        static const char *const controllers[] {"+memory", "+cpu", "+io"};
+
+        for (auto controller : controllers)
+            write_file(dir + "/cgroup.subtree_control", controller);
+    }
+
+    // total size of the packs; loose objects are small in comparison
+
+    static unsigned long long pack_size(const std::string &path)
+    {
+        const std::string pack_dir =path + "/objects/pack";
+
+        DIR *dir =opendir(pack_dir.c_str());
+
+        if (!dir)
+            return 0;
+
+        unsigned long long total =0;
+
+        while (const struct dirent *de =readdir(dir))
+        {
+            const size_t length =strlen(de->d_name);
+
+            if (length < 5
+                || strcmp(de->d_name + length - 5, ".pack") != 0)
+            {
+                continue;
+            }
+
+            struct stat st;
+
+            if (fstatat(dirfd(dir), de->d_name, &st, 0) == 0)
+                total += st.st_size;
+        }
+
+        closedir(dir);
+        return total;
+    }
+
+    static void remove_empty_groups(const std::string &class_dir)
+    {
+        DIR *dir =opendir(class_dir.c_str());
+
+        if (!dir)
+            return;
+
+        while (const struct dirent *de =readdir(dir))
+        {
+            if (strncmp(de->d_name, "conn-", 5) == 0)
+                rmdir((class_dir + '/' + de->d_name).c_str());
+        }
+
+        closedir(dir);
+    }
+}
+
+// *********************************************************
+
+const config::resource_class &cgroup::classify(const std::string &user,
+                                               const std::string &path,
+                                               bool mirrored)
+{
+    const auto ptr =config::user_resource_classes.find(user);
+
+    if (ptr != config::user_resource_classes.end())
+        return ptr->second;
+
+    if (mirrored)
+        return config::mirror_resource_class;
+
+    if (config::large_repository_mib != 0
+        && pack_size(path) > config::large_repository_mib * 1024ull * 1024)
+    {
+        return config::large_resource_class;
+    }
+
+    return config::default_resource_class;
+}
+
+bool cgroup::enter(const config::resource_class &rc)
+{
+    if (config::cgroup_path.empty())
+        return false;
+
+    const std::string class_dir =config::cgroup_path + '/' + rc.name;
+
+    enable_controllers(config::cgroup_path);
+
+    if (mkdir(class_dir.c_str(), 0755) != 0
+        && errno != EEXIST)
+    {
+        return false;
+    }
+
+    enable_controllers(class_dir);
+
+    remove_empty_groups(class_dir);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/conn-%d", static_cast<int>(getpid()));
+
+    const std::string group =class_dir + name;
+
+    if (mkdir(group.c_str(), 0755) != 0)
+        return false;
+
+    // a missing controller only loses that limit
+
+    char value[32];
+
+    write_file(group + "/memory.max", rc.memory_max);
+
+    snprintf(value, sizeof(value), "%u", rc.cpu_weight);
+    write_file(group + "/cpu.weight", value);
+
+    snprintf(value, sizeof(value), "default %u", rc.io_weight);
+    write_file(group + "/io.weight", value);
+
+    if (!write_file(group + "/cgroup.procs", "0")) {
+        rmdir(group.c_str());
+        return false;
+    }
+
+    return true;
+}
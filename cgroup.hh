@@ -0,0 +1,37 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_CGROUP_HEADER
+#define GIT_JUNCTION_CGROUP_HEADER
+
+#include "config.hh"
+
+#include <string>
+
+// Places junction-shell (and so the git command it runs) in a cgroup v2
+// group of its own, <config::cgroup_path>/<class>/conn-<pid>, limited by
+// the resource class. config::cgroup_path must be delegated to user git,
+// and so must the closest common ancestor of it and the group of sshd's
+// session, as moving a process needs write access to its cgroup.procs
+// (see INSTALL.txt).
+// The group can't be removed by its last process, so empty groups of
+// earlier connections are removed when a new one is created; rmdir() fails
+// for a group which still has processes.
+
+class cgroup {
+public:
+    // chooses the class of a connection: per user override, mirrored,
+    // large (see config::large_repository_mib) or default
+    static const config::resource_class &classify(const std::string &user,
+                                                  const std::string &path,
+                                                  bool mirrored);
+
+    // best effort; returns false, leaving the process where it was, when
+    // cgroups are not configured or not available
+    static bool enter(const config::resource_class &);
+};
+
+#endif
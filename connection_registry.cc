@@ -0,0 +1,148 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "connection_registry.hh"
+#include "config.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        pid_bits =22,           // pid_max is at most 2^22
+    };
+
+    // the start time of a process in clock ticks since boot, 0 if it is
+    // gone or /proc can't tell
+
+    static uint64_t start_time(pid_t pid)
+    {
+        char file[32];
+        snprintf(file, sizeof(file), "/proc/%d/stat", static_cast<int>(pid));
+
+        const int fd =open(file, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            return 0;
+
+        char buffer[512];
+        const ssize_t size =read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+
+        if (size <= 0)
+            return 0;
+
+        buffer[size] =0;
+
+        // the command (field 2) is in parentheses and may contain anything;
+        // the start time is field 22
+
+        const char *ptr =strrchr(buffer, ')');
+
+        for (unsigned int field =2;
+             ptr && field < 22;
+             ++field)
+        {
+            ptr =strchr(ptr + 1, ' ');
+        }
+
+        return ptr ? strtoull(ptr + 1, nullptr, 10) : 0;
+    }
+
+    static bool alive(uint64_t entry)
+    {
+        const pid_t pid =static_cast<pid_t>(entry & ((uint64_t{1} << pid_bits) - 1));
+        const uint64_t start =entry >> pid_bits;
+
+        if (start != 0)
+            return start_time(pid) == start;
+
+        return kill(pid, 0) == 0
+            || errno != ESRCH;
+    }
+}
+
+// *********************************************************
+
+connection_registry::connection_registry(bool writable)
+    : shm{config::connections_shm_name, sizeof(segment), writable},
+      seg{static_cast<segment *>(shm.get())}
+{
+    if (writable)
+        shm.claim_version(version);
+}
+
+void connection_registry::add()
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return;
+
+    const pid_t pid =getpid();
+    const uint64_t entry =(start_time(pid) << pid_bits) | static_cast<uint64_t>(pid);
+
+    for (unsigned int i =0; i < slot_count; ++i)
+    {
+        uint64_t expected =0;
+
+        if (__atomic_compare_exchange_n(&seg->entries[i], &expected, entry, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+    }
+}
+
+unsigned int connection_registry::live()
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return 0;
+
+    unsigned int count =0;
+
+    for (unsigned int i =0; i < slot_count; ++i)
+    {
+        uint64_t entry =__atomic_load_n(&seg->entries[i], __ATOMIC_RELAXED);
+
+        if (entry == 0)
+            continue;
+
+        if (alive(entry)) {
+            ++count;
+            continue;
+        }
+
+        // unless somebody got there first
+        __atomic_compare_exchange_n(&seg->entries[i], &entry, uint64_t{0}, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+
+    return count;
+}
+
+unsigned int connection_registry::enter()
+{
+    try {
+        connection_registry registry{true};
+
+        registry.add();
+
+        const unsigned int count =registry.live();
+
+        return count ? count : 1;
+    }
+    catch (...) {
+        return 1;
+    }
+}
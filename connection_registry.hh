@@ -0,0 +1,51 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_CONNECTION_REGISTRY_HEADER
+#define GIT_JUNCTION_CONNECTION_REGISTRY_HEADER
+
+#include "shm_segment.hh"
+
+#include <cstdint>
+
+// Process ids of live junction-shell connections, in shared memory. A
+// connection claims a free slot with a compare and swap and never releases
+// it: after exec the pid is git's, and a slot whose process is gone is
+// freed by whoever counts next. Each entry holds the process' start time
+// (from /proc/<pid>/stat) above the pid, so that a reused pid doesn't keep
+// the slot.
+
+class connection_registry {
+public:
+    enum {
+        version    =2,          // bump when the segment layout changes
+        slot_count =1024,
+    };
+
+    struct segment {
+        uint64_t version;
+        uint64_t entries[slot_count];   // start time << 22 | pid, 0 = free
+    };
+
+private:
+    shm_segment shm;
+    segment *seg;
+
+public:
+    connection_registry(bool writable);
+
+    // registers the calling process
+    void add();
+
+    // the number of live registered processes; frees the dead ones' slots
+    unsigned int live();
+
+    // registers and returns the count including the caller; best effort,
+    // 1 on failure
+    static unsigned int enter();
+};
+
+#endif
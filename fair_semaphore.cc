@@ -0,0 +1,291 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "fair_semaphore.hh"
+#include "config.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <cerrno>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        poll_interval_us =20000,
+    };
+
+    static void make_directory(const std::string &path)
+    {
+        if (mkdir(path.c_str(), 0755) != 0
+            && errno != EEXIST)
+        {
+            throw stdlib_exception{"mkdir(" + path + ")", errno};
+        }
+    }
+
+    static std::vector<std::string> list_directory(const std::string &path)
+    {
+        std::vector<std::string> names;
+
+        DIR *dir =opendir(path.c_str());
+
+        if (!dir)
+            throw stdlib_exception{"opendir(" + path + ")", errno};
+
+        while (struct dirent *dirent =readdir(dir))
+        {
+            if (dirent->d_name[0] != '.')
+                names.push_back(dirent->d_name);
+        }
+
+        closedir(dir);
+
+        return names;
+    }
+
+    static void notice(const std::string &message)
+    {
+        // the client sees this through ssh; failing to show it is harmless
+
+        ssize_t result =write(STDERR_FILENO, message.data(), message.size());
+        (void)result;
+    }
+
+    // true if somebody holds a lock on the file
+
+    static bool file_locked(const std::string &path)
+    {
+        const int fd =open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            return false;
+
+        const bool locked =(flock(fd, LOCK_SH | LOCK_NB) != 0);
+
+        close(fd);
+        return locked;
+    }
+}
+
+// *********************************************************
+
+fair_semaphore::fair_semaphore(const std::string &name, const std::string &label, unsigned int l)
+    : dir{config::run_path + '/' + name},
+      label_text{label},
+      limit{l},
+      slot_fd{-1},
+      queue_fd{-1}
+{
+    if (limit == 0)
+        return;
+
+    if (mkdir(dir.c_str(), 0755) == 0) {
+        std::ofstream ofs{dir + "/label"};
+        ofs << label_text << '\n';
+    }
+    else if (errno != EEXIST) {
+        throw stdlib_exception{"mkdir(" + dir + ")", errno};
+    }
+
+    make_directory(dir + "/queue");
+}
+
+fair_semaphore::~fair_semaphore()
+{
+    if (queue_fd >= 0)
+        close(queue_fd);
+    if (slot_fd >= 0)
+        close(slot_fd);
+}
+
+bool fair_semaphore::try_acquire_slot()
+{
+    for (unsigned int i =0; i < limit; ++i)
+    {
+        std::ostringstream slot_oss;
+        slot_oss << dir << "/slot." << i;
+
+        // not inherited by the git command: its background descendants
+        // would keep the slot
+
+        const int fd =open(slot_oss.str().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+        if (fd < 0)
+            throw stdlib_exception{"open(" + slot_oss.str() + ")", errno};
+
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            slot_fd =fd;
+            return true;
+        }
+
+        close(fd);
+    }
+
+    return false;
+}
+
+std::string fair_semaphore::enqueue()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    std::ostringstream tmp_oss, own_oss;
+
+    tmp_oss << dir << "/queue/.tmp-" << getpid();
+    own_oss << dir << "/queue/"
+            << std::setfill('0') << std::setw(10) << ts.tv_sec
+            << std::setw(9) << ts.tv_nsec
+            << '-' << getpid();
+
+    // lock the entry before it becomes visible, so that it never looks stale
+
+    const std::string tmp =tmp_oss.str();
+    unlink(tmp.c_str());
+
+    queue_fd =open(tmp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (queue_fd < 0)
+        throw stdlib_exception{"open(" + tmp + ")", errno};
+
+    if (flock(queue_fd, LOCK_EX) != 0
+        || rename(tmp.c_str(), own_oss.str().c_str()) != 0)
+    {
+        const int error =errno;
+        unlink(tmp.c_str());
+        throw stdlib_exception{"enqueue(" + tmp + ")", error};
+    }
+
+    return own_oss.str();
+}
+
+bool fair_semaphore::wait_for_predecessor(const std::string &own)
+{
+    const std::string queue_dir =dir + "/queue";
+    const std::string own_name =own.substr(queue_dir.size() + 1);
+
+    std::string predecessor;
+
+    {
+        const std::vector<std::string> names =list_directory(queue_dir);
+
+        for (auto ptr =names.begin();
+             ptr != names.end();
+             ++ptr)
+        {
+            if (*ptr < own_name
+                && *ptr > predecessor)
+            {
+                predecessor =*ptr;
+            }
+        }
+    }
+
+    if (predecessor.empty())
+        return false;
+
+    //
+
+    const std::string path =queue_dir + '/' + predecessor;
+    const int fd =open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return true;
+
+    if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+        // the predecessor is gone, without removing its entry
+        unlink(path.c_str());
+    }
+    else {
+        while (flock(fd, LOCK_SH) != 0
+               && errno == EINTR)
+            ;
+    }
+
+    close(fd);
+    return true;
+}
+
+bool fair_semaphore::acquire()
+{
+    if (limit == 0)
+        return false;
+
+    if (list_directory(dir + "/queue").empty()
+        && try_acquire_slot())
+    {
+        return false;
+    }
+
+    const std::string own =enqueue();
+
+    notice("waiting for a free connection slot (" + label_text + ")\n");
+
+    for (;;)
+    {
+        if (wait_for_predecessor(own))
+            continue;
+
+        // head of the queue
+
+        if (try_acquire_slot())
+            break;
+
+        usleep(poll_interval_us);
+    }
+
+    unlink(own.c_str());
+    close(queue_fd);
+    queue_fd =-1;
+
+    return true;
+}
+
+void fair_semaphore::keep()
+{
+    slot_fd =-1;
+}
+
+// *********************************************************
+
+std::vector<std::string> fair_semaphore::names()
+{
+    std::vector<std::string> names =list_directory(config::run_path);
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::string fair_semaphore::label(const std::string &name)
+{
+    std::ifstream ifs{config::run_path + '/' + name + "/label"};
+    std::string line;
+
+    getline(ifs, line);
+    return line;
+}
+
+unsigned int fair_semaphore::queue_depth(const std::string &name)
+{
+    const std::string queue_dir =config::run_path + '/' + name + "/queue";
+    const std::vector<std::string> entries =list_directory(queue_dir);
+
+    return std::count_if(entries.begin(),
+                         entries.end(),
+                         [&queue_dir](const std::string &entry) { return file_locked(queue_dir + '/' + entry); });
+}
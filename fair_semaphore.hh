@@ -0,0 +1,59 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_FAIR_SEMAPHORE_HEADER
+#define GIT_JUNCTION_FAIR_SEMAPHORE_HEADER
+
+#include <string>
+#include <vector>
+
+// Counting semaphore between processes, built from flock()ed files under
+// config::run_path/<name>:
+//
+//   slot.<n>          one per unit of the limit, held with LOCK_EX
+//   queue/<ns>-<pid>  one per waiting process, held with LOCK_EX
+//
+// Waiters are served in arrival order: each waiter blocks on the queue file
+// of its predecessor, and only the head of the queue polls the slots. The
+// kernel releases the locks of crashed processes. An acquired slot is not
+// inherited by child processes; junction-shell keeps it while it waits for
+// the git command.
+
+class fair_semaphore {
+    const std::string dir;
+    const std::string label_text;
+    const unsigned int limit;
+
+    int slot_fd;
+    int queue_fd;
+
+    bool try_acquire_slot();
+    std::string enqueue();
+    bool wait_for_predecessor(const std::string &own);
+
+public:
+    fair_semaphore(const std::string &name, const std::string &label, unsigned int limit);
+    ~fair_semaphore();
+
+    fair_semaphore(const fair_semaphore &) =delete;
+    fair_semaphore &operator= (const fair_semaphore &) =delete;
+
+    // returns true if the caller had to queue; waiting is announced on stderr
+    bool acquire();
+
+    // the slot stays held by this process after the object is gone
+    void keep();
+
+    // *****
+
+    // instrumentation
+
+    static std::vector<std::string> names();
+    static std::string label(const std::string &name);
+    static unsigned int queue_depth(const std::string &name);
+};
+
+#endif
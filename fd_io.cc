@@ -0,0 +1,287 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "fd_io.hh"
+#include "exception.hh"
+
+#include <ostream>
+#include <sstream>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        buffer_size =65536,
+        splice_size =1 << 20,
+    };
+
+    template <typename exception_t>
+    static void report_exception(const char *prefix, const exception_t &e)
+    {
+        std::ostringstream oss;
+        oss << prefix << ": " << e << '\n';
+
+        const std::string message =oss.str();
+
+        ssize_t result =write(STDERR_FILENO, message.data(), message.size());
+        (void)result;
+    }
+
+    // one direction of splice_relay()
+
+    struct splice_stream {
+        int in;
+        int *out;
+        bool out_full;
+        unsigned long long *bytes;
+    };
+}
+
+// *********************************************************
+
+void write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr =static_cast<const char *>(data);
+
+    while (size > 0)
+    {
+        const ssize_t result =write(fd, ptr, size);
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"write", errno};
+        }
+
+        ptr += result;
+        size -= result;
+    }
+}
+
+void write_all(int fd, const std::string &data)
+{
+    write_all(fd, data.data(), data.size());
+}
+
+std::string read_all(int fd)
+{
+    std::string result;
+    char buffer[buffer_size];
+
+    for (;;)
+    {
+        const ssize_t size =read(fd, buffer, sizeof(buffer));
+
+        if (size < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (size == 0)
+            return result;
+
+        result.append(buffer, size);
+    }
+}
+
+unsigned long long copy_fd(int in, int out)
+{
+    unsigned long long total =0;
+
+    // sendfile() works from regular files to anything
+
+    for (;;)
+    {
+        const ssize_t result =sendfile(out, in, nullptr, 1 << 30);
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL && total == 0)
+                break;
+            throw stdlib_exception{"sendfile", errno};
+        }
+
+        if (result == 0)
+            return total;
+
+        total += result;
+    }
+
+    char buffer[buffer_size];
+
+    for (;;)
+    {
+        const ssize_t result =read(in, buffer, sizeof(buffer));
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (result == 0)
+            return total;
+
+        write_all(out, buffer, result);
+        total += result;
+    }
+}
+
+void relay(int client_in, int client_out, int &git_in, int git_out)
+{
+    char buffer[buffer_size];
+
+    struct pollfd fds[2] {
+        {client_in, POLLIN, 0},
+        {git_out,   POLLIN, 0},
+    };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"poll", errno};
+        }
+
+        for (unsigned int i =0; i < 2; ++i)
+        {
+            if (!fds[i].revents)
+                continue;
+
+            const ssize_t result =read(fds[i].fd, buffer, sizeof(buffer));
+
+            if (result < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw stdlib_exception{"read", errno};
+            }
+
+            if (i == 1) {
+                if (result == 0)
+                    return;
+
+                write_all(client_out, buffer, result);
+            }
+            else if (result == 0) {
+                // the client is done sending
+                close(git_in);
+                git_in =-1;
+                fds[0].fd =-1;
+            }
+            else {
+                write_all(git_in, buffer, result);
+            }
+        }
+    }
+}
+
+void splice_relay(int client_in, int client_out, int &git_in, int git_out,
+                  unsigned long long &bytes_in, unsigned long long &bytes_out)
+{
+    splice_stream streams[2] {
+        {client_in, &git_in,     false, &bytes_in},
+        {git_out,   &client_out, false, &bytes_out},
+    };
+
+    // poll the input of a stream, or its output when that was full; the
+    // input is only read after it has been polled readable, so that a
+    // blocking socket from sshd never blocks the other direction
+
+    for (;;)
+    {
+        struct pollfd fds[2];
+
+        for (unsigned int i =0; i < 2; ++i)
+        {
+            if (streams[i].in < 0)
+                fds[i] =pollfd{-1, 0, 0};
+            else if (streams[i].out_full)
+                fds[i] =pollfd{*streams[i].out, POLLOUT, 0};
+            else
+                fds[i] =pollfd{streams[i].in, POLLIN, 0};
+        }
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"poll", errno};
+        }
+
+        for (unsigned int i =0; i < 2; ++i)
+        {
+            splice_stream &stream =streams[i];
+
+            if (!fds[i].revents)
+                continue;
+
+            if (stream.out_full)
+            {
+                stream.out_full =false;
+
+                // git stopped reading its input; anything else waits for
+                // the input again
+
+                if (i == 1 || !(fds[i].revents & POLLERR))
+                    continue;
+            }
+            else if (fds[i].revents & POLLIN)
+            {
+                const ssize_t result =splice(stream.in, nullptr,
+                                             *stream.out, nullptr,
+                                             splice_size,
+                                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+                if (result > 0) {
+                    *stream.bytes += result;
+                    continue;
+                }
+
+                if (result < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN) {
+                        stream.out_full =true;
+                        continue;
+                    }
+                    if (i == 1 || errno != EPIPE)
+                        throw stdlib_exception{"splice", errno};
+                }
+            }
+
+            // EOF, or a hangup with nothing left to read (splice() would
+            // report EPIPE if the client has already gone as well); git is
+            // done when its output ends
+
+            if (i == 1)
+                return;
+
+            close(git_in);
+            git_in =-1;
+            stream.in =-1;
+        }
+    }
+}
+
+void report(const char *prefix, const generic_exception &e)
+{
+    report_exception(prefix, e);
+}
+
+void report(const char *prefix, const stdlib_exception &e)
+{
+    report_exception(prefix, e);
+}
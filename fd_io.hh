@@ -0,0 +1,44 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_FD_IO_HEADER
+#define GIT_JUNCTION_FD_IO_HEADER
+
+#include <string>
+#include <cstddef>
+
+class generic_exception;
+class stdlib_exception;
+
+// Plain file descriptor I/O for junction-shell, which talks to sshd and git
+// through pipes. Failures throw stdlib_exception.
+
+void write_all(int fd, const void *data, size_t size);
+void write_all(int fd, const std::string &data);
+
+// reads until EOF
+std::string read_all(int fd);
+
+// copies until EOF of 'in'; returns the number of bytes copied
+unsigned long long copy_fd(int in, int out);
+
+// copies client_in -> git_in and git_out -> client_out until git_out reaches
+// EOF; git_in is closed (and set to -1) when client_in reaches EOF
+void relay(int client_in, int client_out, int &git_in, int git_out);
+
+// like relay(), but the payload is moved with splice() through the pipes to
+// git and never copied into user space; the bytes moved are added to
+// bytes_in (client to git) and bytes_out (git to client) as they go, so
+// they are valid even when an exception is thrown
+void splice_relay(int client_in, int client_out, int &git_in, int git_out,
+                  unsigned long long &bytes_in, unsigned long long &bytes_out);
+
+// "<prefix>: <exception>" to stderr, which the client sees; junction-shell
+// avoids iostreams, so that they aren't initialized on every connection
+void report(const char *prefix, const generic_exception &);
+void report(const char *prefix, const stdlib_exception &);
+
+#endif
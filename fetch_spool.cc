@@ -0,0 +1,190 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "fetch_spool.hh"
+#include "exception.hh"
+#include "fd_io.hh"
+
+#include <sstream>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        poll_interval_us =10000,
+        lead_attempts    =3,
+    };
+}
+
+// *********************************************************
+
+fetch_spool::fetch_spool(const std::string &dir, const std::string &key)
+    : path{dir + '/' + key},
+      fd{-1},
+      leader{false},
+      failed{false}
+{
+    mkdir(dir.c_str(), 0755);
+
+    for (unsigned int i =0; i < lead_attempts; ++i)
+    {
+        if (lead(dir)) {
+            leader =true;
+            return;
+        }
+
+        if (join())
+            return;
+    }
+
+    // no spooling, but still serve the own client
+
+    leader =true;
+    failed =true;
+}
+
+fetch_spool::~fetch_spool()
+{
+    if (leader)
+        finish(false, std::string{});
+    else if (fd >= 0)
+        close(fd);
+}
+
+bool fetch_spool::lead(const std::string &dir)
+{
+    std::ostringstream tmp_oss;
+    tmp_oss << dir << "/.tmp-" << getpid();
+
+    const std::string tmp =tmp_oss.str();
+    unlink(tmp.c_str());
+
+    // lock before the spool becomes visible, so that it never looks abandoned
+
+    fd =open(tmp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+        return false;
+
+    if (fchmod(fd, 0644) == 0
+        && flock(fd, LOCK_EX) == 0
+        && link(tmp.c_str(), path.c_str()) == 0)
+    {
+        unlink(tmp.c_str());
+        return true;
+    }
+
+    close(fd);
+    fd =-1;
+    unlink(tmp.c_str());
+
+    return false;
+}
+
+bool fetch_spool::join()
+{
+    fd =open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0)
+        return true;            // the leader is at it
+
+    flock(fd, LOCK_UN);
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0
+        && (st.st_mode & 0777) == 0444)
+    {
+        return true;            // complete, not yet removed
+    }
+
+    // abandoned by a leader that died
+
+    unlink(path.c_str());
+    close(fd);
+    fd =-1;
+
+    return false;
+}
+
+void fetch_spool::write(const void *data, size_t size)
+{
+    if (failed || fd < 0)
+        return;
+
+    try {
+        write_all(fd, data, size);
+    }
+    catch (stdlib_exception) {
+        failed =true;
+    }
+}
+
+void fetch_spool::finish(bool success, const std::string &cache_file)
+{
+    if (fd < 0)
+        return;
+
+    if (success
+        && !failed
+        && fchmod(fd, 0444) == 0
+        && !cache_file.empty())
+    {
+        link(path.c_str(), cache_file.c_str());
+    }
+
+    // followers still have the file open; releasing the lock lets them finish
+
+    unlink(path.c_str());
+    close(fd);
+    fd =-1;
+}
+
+bool fetch_spool::follow(int out)
+{
+    char buffer[65536];
+
+    for (;;)
+    {
+        const ssize_t result =read(fd, buffer, sizeof(buffer));
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (result > 0) {
+            write_all(out, buffer, result);
+            continue;
+        }
+
+        // at the end of the spool; wait, unless the leader is done
+
+        if (flock(fd, LOCK_SH | LOCK_NB) != 0) {
+            usleep(poll_interval_us);
+            continue;
+        }
+
+        copy_fd(fd, out);
+
+        struct stat st;
+
+        return fstat(fd, &st) == 0
+            && (st.st_mode & 0777) == 0444;
+    }
+}
@@ -0,0 +1,50 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_FETCH_SPOOL_HEADER
+#define GIT_JUNCTION_FETCH_SPOOL_HEADER
+
+#include <string>
+#include <cstddef>
+
+// Single-flight spool for identical concurrent fetches. The first process
+// to link <dir>/<key> becomes the leader: it runs git and writes the
+// response into the spool while holding an exclusive flock(). Everybody
+// arriving meanwhile is a follower, replaying the spool from the start and
+// then tailing it until the leader lets go of the lock. A complete spool
+// has mode 0444; anything else left behind by the leader is a failure.
+
+class fetch_spool {
+    const std::string path;
+    int fd;
+    bool leader;
+    bool failed;
+
+    bool lead(const std::string &dir);
+    bool join();
+
+public:
+    fetch_spool(const std::string &dir, const std::string &key);
+    ~fetch_spool();
+
+    fetch_spool(const fetch_spool &) =delete;
+    fetch_spool &operator= (const fetch_spool &) =delete;
+
+    bool is_leader() const { return leader; }
+
+    // leader
+
+    void write(const void *data, size_t size);
+
+    // publishes the response for followers, and into 'cache_file' unless
+    // it is empty
+    void finish(bool success, const std::string &cache_file);
+
+    // follower: copies the response to 'out', returns true if it was complete
+    bool follow(int out);
+};
+
+#endif
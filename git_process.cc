@@ -0,0 +1,125 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "git_process.hh"
+#include "config.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//
+
+git_process::git_process(const std::string &command, const std::vector<std::string> &args)
+    : pid{-1},
+      input{-1},
+      output{-1}
+{
+    int fds_in[2]  {-1, -1};
+    int fds_out[2] {-1, -1};
+
+    if (pipe2(fds_in, O_CLOEXEC) != 0
+        || pipe2(fds_out, O_CLOEXEC) != 0)
+    {
+        throw stdlib_exception{"pipe", errno};
+    }
+
+    // build argv before fork, the child must not allocate
+
+    const std::string bin =std::string{config::git_exec_path} + '/' + command;
+
+    std::vector<const char *> argv;
+    argv.push_back(command.c_str());
+
+    for (auto ptr =args.begin();
+         ptr != args.end();
+         ++ptr)
+    {
+        argv.push_back(ptr->c_str());
+    }
+
+    argv.push_back(nullptr);
+
+    if ((pid =fork()) < 0) {
+        throw stdlib_exception{"fork", errno};
+    }
+    else if (pid == 0) // child
+    {
+        if (dup2(fds_in[0], STDIN_FILENO) < 0
+            || dup2(fds_out[1], STDOUT_FILENO) < 0)
+        {
+            _exit(127);
+        }
+
+        execv(bin.c_str(), const_cast<char *const *>(argv.data()));
+
+        perror("execv");
+        _exit(127);
+    }
+
+    // parent
+
+    close(fds_in[0]);
+    close(fds_out[1]);
+
+    input  =fds_in[1];
+    output =fds_out[0];
+}
+
+git_process::~git_process()
+{
+    close_input();
+
+    if (output >= 0)
+        close(output);
+
+    if (pid > 0)
+        wait();
+}
+
+void git_process::close_input()
+{
+    if (input >= 0) {
+        close(input);
+        input =-1;
+    }
+}
+
+int git_process::wait()
+{
+    if (pid <= 0)
+        return 127;
+
+    int status;
+
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR) {
+            pid =-1;
+            return 127;
+        }
+    }
+
+    pid =-1;
+
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+
+    return 128 + WTERMSIG(status);
+}
+
+void git_process::kill()
+{
+    if (pid > 0) {
+        ::kill(pid, SIGKILL);
+        wait();
+    }
+}
@@ -0,0 +1,43 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_GIT_PROCESS_HEADER
+#define GIT_JUNCTION_GIT_PROCESS_HEADER
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// A git command from config::git_exec_path, run with pipes on its stdin and
+// stdout. stderr is shared with junction-shell, so the client sees it.
+// Unlike process_io, there is no shell and no iostream in between.
+
+class git_process {
+    pid_t pid;
+    int input;          // git's stdin
+    int output;         // git's stdout
+
+public:
+    git_process(const std::string &command, const std::vector<std::string> &args);
+    ~git_process();
+
+    git_process(const git_process &) =delete;
+    git_process &operator= (const git_process &) =delete;
+
+    int &in() { return input; }
+    int out() const { return output; }
+
+    void close_input();
+
+    // waits for the command; returns its exit status, or 128 + signal
+    int wait();
+
+    // for when the output is not needed after all
+    void kill();
+};
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "input.hh"
 #include "exception.hh"
+#include "repository_profile.hh"
 #include "terminal_input.hh"
 #include "utils.hh"
 
@@ -94,3 +95,25 @@ std::string read_field(const std::string prompt, bool hide, const accept_field_f
             return input;
     }
 }
+
+std::string read_profile()
+{
+    class accept_profile : public accept_field_functor {
+    public:
+        virtual bool operator() (std::string &input) const
+        {
+            lowercase(input);
+
+            if (input.empty()
+                || repository_profile::exists(input))
+            {
+                return true;
+            }
+
+            std::cout << "unknown profile\n";
+            return false;
+        }
+    };
+
+    return read_field("profile (" + repository_profile::names() + ", empty for none): ", false, accept_profile());
+}
@@ -41,4 +41,7 @@ public:
 
 std::string read_field(const std::string prompt, bool hide, const accept_field_functor &accept);
 
+// a name in config::repository_profiles, or nothing
+std::string read_profile();
+
 #endif
@@ -11,6 +11,7 @@
 #include "restore_ios.hh"
 #include "exception.hh"
 #include "process_io.hh"
+#include "probes.hh"
 
 #include <iostream>
 #include <iomanip>
@@ -232,7 +233,11 @@ void key_menu::install_keys(const std::string &user)
     command_oss << ' ';
     escape << getpid();
 
-    system(command_oss.str().c_str());
+    const probe_timer timer;
+
+    const int status =system(command_oss.str().c_str());
+
+    PROBE3(key_install, user.c_str(), status, timer.elapsed());
 }
 
 key_menu::key_menu(const std::string &u)
@@ -0,0 +1,557 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "lfs_transfer.hh"
+#include "exception.hh"
+#include "fd_io.hh"
+#include "sha256.hh"
+
+#include <sstream>
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        oid_size       =64,
+        data_line_size =pkt_line::max_size - 4,     // as git's LARGE_PACKET_DATA_MAX
+    };
+
+    static bool is_oid(const std::string &oid)
+    {
+        if (oid.size() != oid_size)
+            return false;
+
+        for (auto ptr =oid.begin();
+             ptr != oid.end();
+             ++ptr)
+        {
+            if (!((*ptr >= '0' && *ptr <= '9')
+                  || (*ptr >= 'a' && *ptr <= 'f')))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool parse_size(const std::string &value, unsigned long long &size)
+    {
+        if (value.empty()
+            || value.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+
+        errno =0;
+        size =strtoull(value.c_str(), nullptr, 10);
+
+        return errno == 0;
+    }
+
+    // the value of "size=<n>" among the arguments
+
+    static bool size_argument(const std::vector<std::string> &arguments, unsigned long long &size)
+    {
+        for (auto ptr =arguments.begin();
+             ptr != arguments.end();
+             ++ptr)
+        {
+            if (ptr->compare(0, 5, "size=") == 0)
+                return parse_size(ptr->substr(5), size);
+        }
+
+        return false;
+    }
+
+    static void make_dir(const std::string &dir)
+    {
+        if (mkdir(dir.c_str(), 0755) != 0
+            && errno != EEXIST)
+        {
+            throw stdlib_exception{"mkdir(" + dir + ")", errno};
+        }
+    }
+
+    // "status <code>", the arguments and, after a delim, the lines
+
+    static void respond(unsigned int status,
+                        const std::vector<std::string> &arguments =std::vector<std::string>{},
+                        const std::vector<std::string> &lines =std::vector<std::string>{})
+    {
+        std::string response =pkt_line::encode("status " + std::to_string(status) + '\n');
+
+        for (auto ptr =arguments.begin();
+             ptr != arguments.end();
+             ++ptr)
+        {
+            response += pkt_line::encode(*ptr + '\n');
+        }
+
+        if (!lines.empty())
+        {
+            response += pkt_line::delim;
+
+            for (auto ptr =lines.begin();
+                 ptr != lines.end();
+                 ++ptr)
+            {
+                response += pkt_line::encode(*ptr + '\n');
+            }
+        }
+
+        response += pkt_line::flush;
+
+        write_all(STDOUT_FILENO, response);
+    }
+
+    static void respond_error(unsigned int status, const std::string &message)
+    {
+        respond(status, std::vector<std::string>{}, std::vector<std::string>{message});
+    }
+}
+
+// *********************************************************
+
+lfs_transfer::lfs_transfer(const std::string &p, bool u)
+    : path{p},
+      upload{u},
+      client_reader{STDIN_FILENO}
+{
+}
+
+std::string lfs_transfer::object_file(const std::string &oid) const
+{
+    return path + "/lfs/objects/" + oid.substr(0, 2) + '/' + oid.substr(2, 2) + '/' + oid;
+}
+
+bool lfs_transfer::object_size(const std::string &oid, unsigned long long &size) const
+{
+    struct stat st;
+
+    if (stat(object_file(oid).c_str(), &st) != 0
+        || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    size =st.st_size;
+    return true;
+}
+
+// reads the command and its arguments; 'has_data' tells if a delim and
+// more follow. Returns false when the client is gone.
+
+bool lfs_transfer::read_request(std::string &command, std::vector<std::string> &arguments, bool &has_data)
+{
+    std::string raw;
+
+    if (!client_reader.read(raw))
+        return false;
+
+    if (raw.size() <= 4)
+        throw generic_exception{"lfs-transfer request without a command"};
+
+    command =pkt_line::text(raw);
+    arguments.clear();
+
+    for (;;)
+    {
+        if (!client_reader.read(raw))
+            throw generic_exception{"truncated lfs-transfer request"};
+
+        if (pkt_line::is_flush(raw)) {
+            has_data =false;
+            return true;
+        }
+
+        if (pkt_line::is_delim(raw)) {
+            has_data =true;
+            return true;
+        }
+
+        arguments.push_back(pkt_line::text(raw));
+    }
+}
+
+std::vector<std::string> lfs_transfer::read_lines()
+{
+    std::vector<std::string> lines;
+    std::string raw;
+
+    for (;;)
+    {
+        if (!client_reader.read(raw))
+            throw generic_exception{"truncated lfs-transfer request"};
+
+        if (pkt_line::is_flush(raw))
+            return lines;
+
+        lines.push_back(pkt_line::text(raw));
+    }
+}
+
+void lfs_transfer::skip_data()
+{
+    std::string raw;
+
+    for (;;)
+    {
+        if (!client_reader.read(raw))
+            throw generic_exception{"truncated lfs-transfer request"};
+
+        if (pkt_line::is_flush(raw))
+            return;
+    }
+}
+
+void lfs_transfer::batch(const std::vector<std::string> &arguments, bool has_data)
+{
+    const std::vector<std::string> lines =has_data ? read_lines() : std::vector<std::string>{};
+
+    for (auto ptr =arguments.begin();
+         ptr != arguments.end();
+         ++ptr)
+    {
+        if (ptr->compare(0, 10, "hash-algo=") == 0
+            && *ptr != "hash-algo=sha256")
+        {
+            respond_error(400, "unsupported hash algorithm");
+            return;
+        }
+    }
+
+    // "<oid> <size>" in, "<oid> <size> <action>" out
+
+    std::vector<std::string> actions;
+
+    for (auto ptr =lines.begin();
+         ptr != lines.end();
+         ++ptr)
+    {
+        const std::string::size_type space =ptr->find(' ');
+
+        std::string oid;
+        unsigned long long size;
+
+        if (space == std::string::npos
+            || !is_oid(oid =ptr->substr(0, space))
+            || !parse_size(ptr->substr(space + 1), size))
+        {
+            respond_error(400, "invalid object in batch: " + *ptr);
+            return;
+        }
+
+        unsigned long long stored_size;
+        const bool stored =object_size(oid, stored_size);
+
+        const char *action;
+
+        if (upload) {
+            action =(stored && stored_size == size) ? "noop" : "upload";
+        }
+        else {
+            action =stored ? "download" : "noop";
+
+            if (stored)
+                size =stored_size;
+        }
+
+        actions.push_back(oid + ' ' + std::to_string(size) + ' ' + action);
+    }
+
+    respond(200, std::vector<std::string>{"hash-algo=sha256"}, actions);
+}
+
+void lfs_transfer::put_object(const std::string &oid, const std::vector<std::string> &arguments, bool has_data)
+{
+    unsigned long long size;
+
+    if (!has_data) {
+        respond_error(400, "missing object data");
+        return;
+    }
+
+    if (!upload) {
+        skip_data();
+        respond_error(403, "objects can't be uploaded in a download session");
+        return;
+    }
+
+    if (!is_oid(oid)
+        || !size_argument(arguments, size))
+    {
+        skip_data();
+        respond_error(400, "invalid object id or size");
+        return;
+    }
+
+    {
+        unsigned long long stored_size;
+
+        if (object_size(oid, stored_size)
+            && stored_size == size)
+        {
+            skip_data();
+            respond(200);
+            return;
+        }
+    }
+
+    make_dir(path + "/lfs");
+    make_dir(path + "/lfs/tmp");
+
+    std::ostringstream tmp_oss;
+    tmp_oss << path << "/lfs/tmp/" << oid << '.' << getpid();
+
+    const std::string tmp =tmp_oss.str();
+
+    int fd =open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool failed =(fd < 0);
+
+    // the data must be read in any case, to stay in sync with the client
+
+    sha256 hash;
+    unsigned long long received =0;
+    std::string raw;
+
+    for (;;)
+    {
+        if (!client_reader.read(raw)) {
+            if (fd >= 0) {
+                close(fd);
+                unlink(tmp.c_str());
+            }
+            throw generic_exception{"truncated lfs-transfer object"};
+        }
+
+        if (pkt_line::is_flush(raw))
+            break;
+
+        if (raw.size() <= 4)
+            continue;
+
+        hash.update(raw.data() + 4, raw.size() - 4);
+        received += raw.size() - 4;
+
+        if (!failed) {
+            try {
+                write_all(fd, raw.data() + 4, raw.size() - 4);
+            }
+            catch (stdlib_exception) {
+                failed =true;
+            }
+        }
+    }
+
+    if (fd >= 0
+        && (fsync(fd) != 0 || close(fd) != 0))
+    {
+        failed =true;
+    }
+
+    if (failed) {
+        unlink(tmp.c_str());
+        respond_error(500, "failed to store the object");
+        return;
+    }
+
+    if (received != size
+        || hash.hex_digest() != oid)
+    {
+        unlink(tmp.c_str());
+        respond_error(400, "object doesn't match its size or id");
+        return;
+    }
+
+    make_dir(path + "/lfs/objects");
+    make_dir(path + "/lfs/objects/" + oid.substr(0, 2));
+    make_dir(path + "/lfs/objects/" + oid.substr(0, 2) + '/' + oid.substr(2, 2));
+
+    if (rename(tmp.c_str(), object_file(oid).c_str()) != 0) {
+        unlink(tmp.c_str());
+        respond_error(500, "failed to store the object");
+        return;
+    }
+
+    respond(200);
+}
+
+void lfs_transfer::verify_object(const std::string &oid, const std::vector<std::string> &arguments)
+{
+    unsigned long long size, stored_size;
+
+    if (!is_oid(oid)
+        || !size_argument(arguments, size))
+    {
+        respond_error(400, "invalid object id or size");
+    }
+    else if (!object_size(oid, stored_size)
+             || stored_size != size)
+    {
+        respond_error(404, "object not found");
+    }
+    else {
+        respond(200);
+    }
+}
+
+void lfs_transfer::get_object(const std::string &oid)
+{
+    if (!is_oid(oid)) {
+        respond_error(400, "invalid object id");
+        return;
+    }
+
+    const int fd =open(object_file(oid).c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0
+        || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+
+        respond_error(404, "object not found");
+        return;
+    }
+
+    try {
+        write_all(STDOUT_FILENO,
+                  pkt_line::encode("status 200\n")
+                  + pkt_line::encode("size=" + std::to_string(st.st_size) + '\n')
+                  + pkt_line::delim);
+
+        char buffer[data_line_size];
+
+        for (;;)
+        {
+            const ssize_t result =read(fd, buffer, sizeof(buffer));
+
+            if (result < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw stdlib_exception{"read", errno};
+            }
+
+            if (result == 0)
+                break;
+
+            write_all(STDOUT_FILENO, pkt_line::encode(std::string{buffer, static_cast<size_t>(result)}));
+        }
+
+        write_all(STDOUT_FILENO, pkt_line::flush);
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+}
+
+// the server advertises its version, the client picks one
+
+bool lfs_transfer::handshake()
+{
+    write_all(STDOUT_FILENO, pkt_line::encode("version=1\n") + pkt_line::flush);
+
+    std::string command;
+    std::vector<std::string> arguments;
+    bool has_data;
+
+    if (!read_request(command, arguments, has_data))
+        return false;
+
+    if (has_data)
+        skip_data();
+
+    if (command != "version 1") {
+        respond_error(400, "unsupported protocol version");
+        return false;
+    }
+
+    respond(200);
+    return true;
+}
+
+// returns false after "quit" or when the client is gone
+
+bool lfs_transfer::serve_request()
+{
+    std::string command;
+    std::vector<std::string> arguments;
+    bool has_data;
+
+    if (!read_request(command, arguments, has_data))
+        return false;
+
+    const std::string::size_type space =command.find(' ');
+
+    const std::string verb =command.substr(0, space);
+    const std::string oid  =(space != std::string::npos) ? command.substr(space + 1) : std::string{};
+
+    if (verb == "batch")
+        batch(arguments, has_data);
+    else if (verb == "put-object")
+        put_object(oid, arguments, has_data);
+    else {
+        if (has_data)
+            skip_data();
+
+        if (verb == "verify-object")
+            verify_object(oid, arguments);
+        else if (verb == "get-object")
+            get_object(oid);
+        else if (verb == "list-lock")
+            respond(200);
+        else if (verb == "lock" || verb == "unlock")
+            respond_error(501, "locking is not supported");
+        else if (verb == "quit") {
+            respond(200);
+            return false;
+        }
+        else {
+            respond_error(400, "unknown command: " + verb);
+        }
+    }
+
+    return true;
+}
+
+// *********************************************************
+
+int lfs_transfer::serve(const std::string &path, const std::string &operation)
+{
+    try {
+        lfs_transfer transfer{path, operation == "upload"};
+
+        if (!transfer.handshake())
+            return 1;
+
+        while (transfer.serve_request())
+        {
+        }
+
+        return 0;
+    }
+    catch (generic_exception &e) {
+        report("git-lfs-transfer", e);
+        return 1;
+    }
+    catch (stdlib_exception &e) {
+        report("git-lfs-transfer", e);
+        return 2;
+    }
+}
@@ -0,0 +1,55 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_LFS_TRANSFER_HEADER
+#define GIT_JUNCTION_LFS_TRANSFER_HEADER
+
+#include "pkt_line.hh"
+
+#include <string>
+#include <vector>
+
+// Server side of git-lfs' SSH transfer protocol (version 1), which git-lfs
+// runs as "git-lfs-transfer <path> upload|download" instead of talking to
+// an LFS server over HTTP. Objects are kept by their SHA-256 under
+// <repository>/lfs/objects/<2>/<2>/<oid>, the layout of git-lfs' own
+// storage; uploads are written into <repository>/lfs/tmp and renamed into
+// place once their size and hash check out.
+//
+// Requests and responses are pkt-lines: a command or "status <code>",
+// "key=value" arguments, and optionally a delim followed by lines or
+// object data, ending with a flush. Locking is not supported: list-lock
+// finds nothing, lock and unlock fail.
+
+class lfs_transfer {
+    const std::string path;
+    const bool upload;
+
+    pkt_line_reader client_reader;
+
+    lfs_transfer(const std::string &path, bool upload);
+
+    std::string object_file(const std::string &oid) const;
+    bool object_size(const std::string &oid, unsigned long long &size) const;
+
+    bool read_request(std::string &command, std::vector<std::string> &arguments, bool &has_data);
+    std::vector<std::string> read_lines();
+    void skip_data();
+
+    void batch(const std::vector<std::string> &arguments, bool has_data);
+    void put_object(const std::string &oid, const std::vector<std::string> &arguments, bool has_data);
+    void verify_object(const std::string &oid, const std::vector<std::string> &arguments);
+    void get_object(const std::string &oid);
+
+    bool handshake();
+    bool serve_request();
+
+public:
+    // 'operation' is "upload" or "download"
+    static int serve(const std::string &path, const std::string &operation);
+};
+
+#endif
@@ -9,10 +9,13 @@
 #include "exception.hh"
 #include "input.hh"
 #include "cgitrc.hh"
+#include "access_map_builder.hh"
 #include "utils.hh"
 #include "repository_menu.hh"
 #include "restore_ios.hh"
 #include "key_menu.hh"
+#include "ref_format.hh"
+#include "repository_profile.hh"
 
 #include <iostream>
 #include <sstream>
@@ -207,6 +210,8 @@ void main_menu::share_local_repository(const std::string &user)
         return;
     }
 
+    const std::string profile =config::repository_profiles.empty() ? "" : read_profile();
+
     // "Are you sure?"
 
     {
@@ -231,15 +236,24 @@ void main_menu::share_local_repository(const std::string &user)
     escape << new_path;
     command_oss << " && git --git-dir=";
     escape << new_path;
-    command_oss << " init";
+    command_oss << " init " << ref_format::init_option();
 
     system(command_oss.str().c_str());
 
     // create cgitrc
 
     cgitrc rc =cgitrc::new_instance(user, cgitrc::repo_type::shared);
+
+    if (config::reftable_new_repositories)
+        rc.set_flag(cgitrc::f_reftable);
+
+    rc.set_profile(profile);
     rc.export_to_file(new_path + "/cgitrc");
 
+    repository_profile::apply(new_path, profile);
+
+    access_map_builder::rebuild();
+
     // instructions
 
     if (!config::clone_url_base.empty()) {
@@ -284,6 +298,8 @@ void main_menu::mirror_remote_repository(const std::string &user)
     if (url.empty())
         return;
 
+    const std::string profile =config::repository_profiles.empty() ? "" : read_profile();
+
     // "Are you sure?"
 
     {
@@ -305,7 +321,7 @@ void main_menu::mirror_remote_repository(const std::string &user)
     std::ostringstream command_oss;
     escape_bash escape{command_oss};
 
-    command_oss << "git clone --mirror ";
+    command_oss << "git clone --mirror " << ref_format::init_option();
     escape << url;
     command_oss << ' ';
     escape << new_path;
@@ -315,8 +331,17 @@ void main_menu::mirror_remote_repository(const std::string &user)
     // create cgitrc
 
     cgitrc rc =cgitrc::new_instance(user, cgitrc::repo_type::mirrored);
+
+    if (config::reftable_new_repositories)
+        rc.set_flag(cgitrc::f_reftable);
+
+    rc.set_profile(profile);
     rc.export_to_file(new_path + "/cgitrc");
 
+    repository_profile::apply(new_path, profile);
+
+    access_map_builder::rebuild();
+
     //
     read_field("\n(press enter)", true, accept_enter());
 }
@@ -0,0 +1,241 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "activity_table.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "maintenance.hh"
+#include "object_pools.hh"
+#include "repository_profile.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Maintains the repositories in the background, see maintenance.hh. Scans
+// for due repositories every config::maint_interval_seconds and works on
+// up to config::maint_workers of them at once, most urgent first. Runs
+// niced and in the idle IO class, and pauses while the load average is
+// above config::maint_max_load_percent. Each scan first applies the
+// repository profiles (see repository_profile.hh) and, with
+// config::pool_path set, moves the objects of related repositories into
+// object pools (see object_pools.hh).
+
+namespace
+{
+    enum {
+        load_check_seconds =30,
+
+        // see ioprio_set(2)
+        ioprio_who_process =1,
+        ioprio_class_idle  =3,
+        ioprio_class_shift =13,
+    };
+
+    // also for the git processes started
+
+    static void throttle()
+    {
+        if (setpriority(PRIO_PROCESS, 0, config::maint_nice) != 0)
+            throw stdlib_exception{"setpriority()", errno};
+
+        if (syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << ioprio_class_shift) != 0)
+            throw stdlib_exception{"ioprio_set()", errno};
+    }
+
+    static void wait_for_load()
+    {
+        if (config::maint_max_load_percent == 0)
+            return;
+
+        const long cpus =std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+        double load;
+
+        while (getloadavg(&load, 1) == 1
+               && load * 100 > config::maint_max_load_percent * cpus)
+        {
+            sleep(load_check_seconds);
+        }
+    }
+
+    // *****
+
+    class worker_pool {
+        const std::vector<maintenance::candidate> &jobs;
+
+        std::mutex mutex;
+        size_t next;
+        std::vector<maintenance::candidate> succeeded;
+
+        void work();
+
+    public:
+        worker_pool(const std::vector<maintenance::candidate> &j)
+            : jobs(j), next{0} {}
+
+        // returns the jobs that succeeded
+        std::vector<maintenance::candidate> run();
+    };
+
+    void worker_pool::work()
+    {
+        for (;;)
+        {
+            const maintenance::candidate *job;
+
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+
+                if (next == jobs.size())
+                    return;
+
+                job =&jobs[next++];
+            }
+
+            wait_for_load();
+
+            const time_t start =time(nullptr);
+            bool ok;
+
+            try {
+                ok =maintenance::run(job->path);
+            }
+            catch (generic_exception &e) {
+                std::lock_guard<std::mutex> lock{mutex};
+                std::cerr << "junction-maint: " << e << "\n";
+                ok =false;
+            }
+            catch (stdlib_exception &e) {
+                std::lock_guard<std::mutex> lock{mutex};
+                std::cerr << "junction-maint: " << e << "\n";
+                ok =false;
+            }
+
+            std::lock_guard<std::mutex> lock{mutex};
+
+            if (!ok) {
+                std::cerr << "junction-maint: " << job->path << ": maintenance failed\n";
+                continue;
+            }
+
+            succeeded.push_back(*job);
+
+            std::cout << "junction-maint: " << job->path << " (priority " << job->priority << ") in "
+                      << time(nullptr) - start << " s" << std::endl;
+        }
+    }
+
+    std::vector<maintenance::candidate> worker_pool::run()
+    {
+        const size_t count =std::min(jobs.size(), static_cast<size_t>(std::max(int{config::maint_workers}, 1)));
+
+        std::vector<std::thread> workers;
+
+        for (size_t i =0; i < count; ++i)
+            workers.emplace_back(&worker_pool::work, this);
+
+        for (auto ptr =workers.begin();
+             ptr != workers.end();
+             ++ptr)
+        {
+            ptr->join();
+        }
+
+        return succeeded;
+    }
+}
+
+// *********************************************************
+
+int main(int argc, char *argv[])
+{
+    enum {
+        return_ok =0,
+        return_usage_error,
+        return_stdlib_error,
+        return_generic_error,
+    };
+
+    const bool once =(argc == 2 && std::string{argv[1]} == "--once");
+
+    if (argc > 2
+        || (argc == 2 && !once))
+    {
+        std::cerr << "usage: junction-maint [--once]\n";
+        return return_usage_error;
+    }
+
+    try {
+        throttle();
+
+        maintenance m;
+        object_pools pools;
+
+        for (;;)
+        {
+            {
+                const unsigned int changed =repository_profile::apply_all();
+
+                if (changed > 0)
+                    std::cout << "junction-maint: profile of " << changed << " repositories applied" << std::endl;
+            }
+
+            if (!config::pool_path.empty())
+            {
+                const unsigned int linked =pools.update();
+
+                if (linked > 0)
+                    std::cout << "junction-maint: " << linked << " repositories linked to object pools" << std::endl;
+            }
+
+            std::unique_ptr<activity_table> table;
+
+            try {
+                table.reset(new activity_table{false});
+            }
+            catch (stdlib_exception) {
+                // no git command recorded yet
+            }
+
+            const std::vector<maintenance::candidate> jobs =m.due(table.get());
+            const std::vector<maintenance::candidate> succeeded =worker_pool{jobs}.run();
+
+            for (auto ptr =succeeded.begin();
+                 ptr != succeeded.end();
+                 ++ptr)
+            {
+                m.maintained(*ptr);
+            }
+
+            if (once)
+                break;
+
+            sleep(config::maint_interval_seconds);
+        }
+    }
+    catch (generic_exception &e) {
+        std::cerr << "junction-maint: " << e << "\n";
+        return return_generic_error;
+    }
+    catch (stdlib_exception &e) {
+        std::cerr << "junction-maint: " << e << "\n";
+        return return_stdlib_error;
+    }
+
+    return return_ok;
+}
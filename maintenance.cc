@@ -0,0 +1,239 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "maintenance.hh"
+#include "access_map.hh"
+#include "activity_table.hh"
+#include "blob_packs.hh"
+#include "cgitrc.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "ref_format.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <utime.h>
+
+//
+
+namespace
+{
+    static const char stamp_file[] ="junction-maintained";
+
+    // modification time, 0 if the file does not exist
+
+    static time_t mtime(const std::string &file)
+    {
+        struct stat st;
+
+        if (stat(file.c_str(), &st) != 0)
+            return 0;
+
+        return st.st_mtime;
+    }
+
+    // whether the cgitrc asks for reftable, which the repository does not
+    // use yet
+
+    static bool wants_reftable(const std::string &path)
+    {
+        try {
+            return cgitrc::import_from_file(path + "/cgitrc").flag(cgitrc::f_reftable)
+                && !ref_format::is_reftable(path);
+        }
+        catch (import_exception) {
+            return false;
+        }
+    }
+
+    static bool wants_blob_packs(const std::string &path)
+    {
+        try {
+            return !config::blob_pack_path.empty()
+                && cgitrc::import_from_file(path + "/cgitrc").flag(cgitrc::f_blob_packs);
+        }
+        catch (import_exception) {
+            return false;
+        }
+    }
+
+    // entries whose name starts with 'prefix' and ends with 'suffix'
+
+    static unsigned int count_entries(const std::string &dir, const char *prefix, const char *suffix)
+    {
+        unsigned int count =0;
+
+        try {
+            opendir_raii d{dir};
+            struct dirent *dirent;
+
+            const size_t prefix_size =strlen(prefix);
+            const size_t suffix_size =strlen(suffix);
+
+            while ((dirent =d.readdir()))
+            {
+                const size_t size =strlen(dirent->d_name);
+
+                if (dirent->d_name[0] != '.'
+                    && size >= prefix_size + suffix_size
+                    && strncmp(dirent->d_name, prefix, prefix_size) == 0
+                    && strcmp(dirent->d_name + size - suffix_size, suffix) == 0)
+                {
+                    ++count;
+                }
+            }
+        }
+        catch (stdlib_exception) {
+        }
+
+        return count;
+    }
+
+    // weights of priority; a push outweighs a handful of packs, 256 loose
+    // objects count like one pack
+
+    enum {
+        push_weight        =16,
+        loose_objects_unit =256,
+    };
+
+    class maintenance_scanner : public git_dir_functor {
+        const std::map<std::string, uint64_t> &maintained_pushes;
+        const activity_table *table;
+        std::vector<maintenance::candidate> &result;
+
+    public:
+        maintenance_scanner(const std::map<std::string, uint64_t> &m,
+                            const activity_table *t,
+                            std::vector<maintenance::candidate> &r)
+            : maintained_pushes(m), table{t}, result(r) {}
+
+        virtual void operator() (const std::string &path) const
+        {
+            const time_t stamp =mtime(path + '/' + stamp_file);
+            const unsigned int packs =count_entries(path + "/objects/pack", "pack-", ".pack");
+
+            // estimated like git gc --auto does, from one of the 256 directories
+            const unsigned int loose_objects =count_entries(path + "/objects/17", "", "") * 256;
+
+            uint64_t pushes =0;
+            uint64_t new_pushes =0;
+
+            if (table)
+            {
+                const activity_table::slot *s =table->find(access_map::hash(path.data(), path.size()), path);
+
+                if (s)
+                {
+                    pushes =__atomic_load_n(&s->counts[shell_stats::c_receive_pack], __ATOMIC_RELAXED);
+
+                    auto ptr =maintained_pushes.find(path);
+
+                    if (ptr != maintained_pushes.end())
+                        new_pushes =(pushes >= ptr->second) ? pushes - ptr->second : pushes;
+                    else if (static_cast<time_t>(__atomic_load_n(&s->last_push, __ATOMIC_RELAXED)) > stamp)
+                        new_pushes =1;      // not seen since junction-maint started
+                }
+            }
+
+            if (stamp != 0
+                && mtime(path + "/objects/pack") <= stamp
+                && new_pushes == 0
+                && loose_objects < config::maint_loose_objects
+                && !wants_reftable(path))
+            {
+                return;
+            }
+
+            result.push_back(maintenance::candidate{path,
+                                                    new_pushes * push_weight + packs + loose_objects / loose_objects_unit,
+                                                    pushes});
+        }
+    };
+}
+
+// *********************************************************
+
+std::vector<maintenance::candidate> maintenance::due(const activity_table *table) const
+{
+    std::vector<candidate> result;
+
+    for_each_git_dir(maintenance_scanner(maintained_pushes, table, result));
+
+    std::stable_sort(result.begin(),
+                     result.end(),
+                     [](const candidate &a, const candidate &b) { return a.priority > b.priority; });
+
+    return result;
+}
+
+void maintenance::maintained(const candidate &c)
+{
+    maintained_pushes[c.path] =c.pushes;
+}
+
+bool maintenance::run(const std::string &path)
+{
+    if (wants_reftable(path)
+        && !ref_format::migrate(path, true))
+    {
+        return false;
+    }
+
+    // bitmaps need all objects of the repository, and a multi-pack-index
+    // of a repository left without packs trips git up; a pool has both.
+    // The loose large blobs of blob_packs.hh must stay out of the packs.
+    struct stat st;
+    const bool borrows =(stat((path + "/objects/info/alternates").c_str(), &st) == 0);
+
+    std::ostringstream command_oss;
+    escape_bash escape{command_oss};
+
+    command_oss << "git --git-dir=";
+    escape << path;
+    command_oss << " pack-refs --all --prune"
+        " && git --git-dir=";
+    escape << path;
+    command_oss << " repack -d -q --geometric=2" << (borrows ? " -l" : " --write-midx --write-bitmap-index") <<
+        " && git --git-dir=";
+    escape << path;
+    command_oss << " commit-graph write --reachable --split --changed-paths --no-progress";
+
+    const int status =system(command_oss.str().c_str());
+
+    if (status == -1
+        || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+    {
+        return false;
+    }
+
+    // large blobs pushed since the pack was written
+
+    if (wants_blob_packs(path))
+        blob_packs::update(path);
+
+    // after the repack touched objects/pack; pushes meanwhile are seen in
+    // the push counts
+
+    const std::string file =path + '/' + stamp_file;
+
+    std::ofstream{file};
+
+    if (utime(file.c_str(), nullptr) != 0)
+        throw stdlib_exception{"utime(" + file + ")", errno};
+
+    return true;
+}
@@ -0,0 +1,54 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_MAINTENANCE_HEADER
+#define GIT_JUNCTION_MAINTENANCE_HEADER
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class activity_table;
+
+// Chooses the repositories junction-maint works on. A repository is due
+// when it has never been maintained, has new packs or pushes since it last
+// was, has config::maint_loose_objects loose objects, or is to be migrated
+// to reftable (see ref_format.hh). The most urgent come first: pushes
+// since the last maintenance weigh most, then the number of packs and
+// loose objects.
+//
+// Maintenance migrates the refs if need be and packs them, repacks
+// geometrically into a multi-pack-index with a reachability bitmap (only
+// locally, when the repository borrows from an object pool), and writes a
+// split commit-graph with changed-path Bloom filters. The blob packs of a
+// repository that has them are refreshed (see blob_packs.hh).
+// <repository>/junction-maintained records when it last finished.
+
+class maintenance {
+public:
+    struct candidate {
+        std::string path;
+        uint64_t priority;
+        uint64_t pushes;        // git-receive-pack commands counted so far
+    };
+
+private:
+    // git-receive-pack counts seen at the last maintenance
+    std::map<std::string, uint64_t> maintained_pushes;
+
+public:
+    // 'table' may be nullptr when no activity has been recorded
+    std::vector<candidate> due(const activity_table *table) const;
+
+    // to be called once run() has succeeded
+    void maintained(const candidate &);
+
+    // false if git failed
+    static bool run(const std::string &path);
+};
+
+#endif
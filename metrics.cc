@@ -0,0 +1,164 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "activity_table.hh"
+#include "config.hh"
+#include "exception.hh"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+// Prints the activity table in the Prometheus text exposition format. With
+// a file argument, the output replaces that file atomically, as the
+// node_exporter textfile collector expects.
+
+namespace
+{
+    struct metric {
+        const char *name;
+        const char *type;
+        const char *help;
+    };
+
+    static const metric metrics[] {
+        {"git_junction_fetches_total",     "counter", "git-upload-pack commands per repository."},
+        {"git_junction_pushes_total",      "counter", "git-receive-pack commands per repository."},
+        {"git_junction_archives_total",    "counter", "git-upload-archive commands per repository."},
+        {"git_junction_lfs_transfers_total", "counter", "git-lfs-transfer commands per repository."},
+        {"git_junction_last_access_timestamp_seconds", "gauge", "Start of the latest git command per repository."},
+        {"git_junction_last_push_timestamp_seconds",   "gauge", "Start of the latest git-receive-pack per repository."},
+    };
+
+    static uint64_t value(const activity_table::slot &s, unsigned int m)
+    {
+        switch (m) {
+        case 0:  return __atomic_load_n(&s.counts[shell_stats::c_upload_pack], __ATOMIC_RELAXED);
+        case 1:  return __atomic_load_n(&s.counts[shell_stats::c_receive_pack], __ATOMIC_RELAXED);
+        case 2:  return __atomic_load_n(&s.counts[shell_stats::c_upload_archive], __ATOMIC_RELAXED);
+        case 3:  return __atomic_load_n(&s.counts[shell_stats::c_lfs_transfer], __ATOMIC_RELAXED);
+        case 4:  return __atomic_load_n(&s.last_access, __ATOMIC_RELAXED);
+        default: return __atomic_load_n(&s.last_push, __ATOMIC_RELAXED);
+        }
+    }
+
+    // the repository path relative to config::base_path, escaped for a label value
+
+    static std::string label(const activity_table::slot &s)
+    {
+        std::string path{s.path, strnlen(s.path, activity_table::path_size)};
+
+        if (path.compare(0, config::base_path.size(), config::base_path) == 0)
+            path.erase(0, config::base_path.size());
+
+        std::string result;
+
+        for (auto ptr =path.begin();
+             ptr != path.end();
+             ++ptr)
+        {
+            switch (*ptr) {
+            case '\\': result += "\\\\"; break;
+            case '"':  result += "\\\""; break;
+            case '\n': result += "\\n";  break;
+            default:   result += *ptr;   break;
+            }
+        }
+
+        return result;
+    }
+
+    static void print_metrics(std::ostream &out, const activity_table &table)
+    {
+        for (unsigned int m =0; m < sizeof(metrics) / sizeof(metrics[0]); ++m)
+        {
+            out << "# HELP " << metrics[m].name << ' ' << metrics[m].help << '\n'
+                << "# TYPE " << metrics[m].name << ' ' << metrics[m].type << '\n';
+
+            for (unsigned int i =0; i < activity_table::slot_count; ++i)
+            {
+                const activity_table::slot *s =table.get(i);
+
+                if (!s)
+                    continue;
+
+                const uint64_t v =value(*s, m);
+
+                if (v == 0 && metrics[m].type[0] == 'g')
+                    continue;   // never happened
+
+                out << metrics[m].name << "{repository=\"" << label(*s) << "\"} " << v << '\n';
+            }
+        }
+    }
+}
+
+// *********************************************************
+
+int main(int argc, char *argv[])
+{
+    enum {
+        return_ok =0,
+        return_usage_error,
+        return_stdlib_error,
+        return_generic_error,
+    };
+
+    if (argc > 2) {
+        std::cerr << "usage: junction-metrics [output file]\n";
+        return return_usage_error;
+    }
+
+    try {
+        const activity_table table{false};
+
+        if (argc == 1) {
+            print_metrics(std::cout, table);
+            return return_ok;
+        }
+
+        const std::string file{argv[1]};
+
+        std::ostringstream tmp_oss;
+        tmp_oss << file << ".tmp." << getpid();
+
+        const std::string tmp_file =tmp_oss.str();
+
+        {
+            std::ofstream ofs{tmp_file};
+
+            print_metrics(ofs, table);
+
+            if (!ofs.flush()) {
+                unlink(tmp_file.c_str());
+                throw generic_exception{"failed to write " + tmp_file};
+            }
+        }
+
+        if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+            const int error =errno;
+            unlink(tmp_file.c_str());
+            throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", error};
+        }
+    }
+    catch (generic_exception &e) {
+        std::cerr << "junction-metrics: " << e << "\n";
+        return return_generic_error;
+    }
+    catch (stdlib_exception &e) {
+        std::cerr << "junction-metrics: " << e << "\n";
+        return return_stdlib_error;
+    }
+
+    return return_ok;
+}
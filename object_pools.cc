@@ -0,0 +1,500 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "object_pools.hh"
+#include "access_map.hh"
+#include "cgitrc.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "process_io.hh"
+#include "ref_state.hh"
+#include "restore_ios.hh"
+#include "utils.hh"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//
+
+namespace
+{
+    typedef std::map<std::string, std::vector<std::string>> groups_t;
+
+    static void git_command(std::ostringstream &command_oss, const std::string &path)
+    {
+        escape_bash escape{command_oss};
+
+        command_oss << "git --git-dir=";
+        escape << path;
+        command_oss << ' ';
+    }
+
+    static bool run(const std::string &command)
+    {
+        const int status =system(command.c_str());
+
+        return status != -1
+            && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+    }
+
+    // all output of 'command'
+
+    static std::string output(const std::string &command)
+    {
+        process_io process{command};
+        process.close_write();
+
+        std::ostringstream oss;
+        oss << process.read().rdbuf();
+
+        return oss.str();
+    }
+
+    // the hash of the path, as the pool names the refs of a member
+
+    static std::string member_id(const std::string &path)
+    {
+        std::ostringstream oss;
+        const restore_ios rios{oss};
+
+        oss << std::hex << std::setfill('0') << std::setw(16) << access_map::hash(path.data(), path.size());
+
+        return oss.str();
+    }
+
+    // the root of HEAD's first-parent history, empty if HEAD is unborn
+
+    static std::string root_commit(const std::string &path)
+    {
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "rev-list --max-parents=0 --first-parent HEAD 2>/dev/null";
+
+        const std::string root =output(command_oss.str());
+
+        return root.substr(0, root.find('\n'));
+    }
+
+    // repositories share a pool only with those of the same owner, or when
+    // all of them are public: the pool of "<root>" or of "<root>.<owner>"
+
+    static std::string pool_name(const std::string &path, const std::string &root)
+    {
+        const cgitrc rc =cgitrc::import_from_file(path + "/cgitrc");
+
+        if (rc.get_type() == cgitrc::repo_type::shared
+            && read_publicity(path))
+        {
+            return root;
+        }
+
+        return root + '.' + rc.get_owner();
+    }
+
+    class root_scanner : public git_dir_functor {
+        std::map<std::string, object_pools::root> &roots;
+        groups_t &groups;
+
+    public:
+        root_scanner(std::map<std::string, object_pools::root> &r, groups_t &g)
+            : roots(r), groups(g) {}
+
+        virtual void operator() (const std::string &path) const
+        {
+            std::string ref_state;
+            std::string commit;
+
+            if (!ref_state_fingerprint(path, ref_state))
+            {
+                // racy, not cached
+                roots.erase(path);
+                commit =root_commit(path);
+            }
+            else
+            {
+                object_pools::root &root =roots[path];
+
+                if (root.ref_state != ref_state)
+                {
+                    root.ref_state =ref_state;
+                    root.commit =root_commit(path);
+                }
+
+                commit =root.commit;
+            }
+
+            if (commit.empty())
+                return;
+
+            try {
+                groups[pool_name(path, commit)].push_back(path);
+            }
+            catch (import_exception) {
+                // no owner, no pool
+            }
+        }
+    };
+
+    // *****
+
+    static void create_pool(const std::string &pool)
+    {
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        command_oss << "git init --quiet --bare ";
+        escape << pool;
+        command_oss << " && ";
+        git_command(command_oss, pool);
+        command_oss << "config repack.useDeltaIslands true && ";
+        git_command(command_oss, pool);
+        command_oss << "config pack.island 'refs/remotes/([0-9a-f]+)/' && ";
+        git_command(command_oss, pool);
+        command_oss << "config gc.auto 0";
+
+        if (!run(command_oss.str()))
+            throw generic_exception{"failed to create " + pool};
+    }
+
+    static bool linked(const std::string &path, const std::string &pool_objects)
+    {
+        std::ifstream ifs{path + "/objects/info/alternates"};
+        std::string line;
+
+        while (getline(ifs, line))
+        {
+            if (line == pool_objects)
+                return true;
+        }
+
+        return false;
+    }
+
+    static void link(const std::string &path, const std::string &pool_objects)
+    {
+        // git-receive-pack advertises the refs of the pool as ".have"
+        // lines; only the member's own, not those of the other members
+
+        {
+            std::ostringstream command_oss;
+
+            git_command(command_oss, path);
+            command_oss << "config core.alternateRefsPrefixes refs/remotes/" << member_id(path) << '/';
+
+            if (!run(command_oss.str()))
+                throw generic_exception{"failed to configure " + path};
+        }
+
+        const std::string file =path + "/objects/info/alternates";
+
+        {
+            std::ofstream ofs{file, std::ios::app};
+
+            ofs << pool_objects << '\n';
+
+            if (!ofs.flush())
+                throw generic_exception{"failed to write " + file};
+        }
+
+        // drop what is in the pool now
+
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "repack -a -d -l -q";
+
+        run(command_oss.str());
+    }
+
+    // takes back the objects a former member borrows from the pool, then
+    // drops the pool from its alternates; false if it still borrows
+
+    static bool leave(const std::string &path, const std::string &pool_objects)
+    {
+        // the commit-graph may list commits that stay behind in the pool
+
+        std::ostringstream command_oss;
+
+        git_command(command_oss, path);
+        command_oss << "repack -a -d -q && ";
+        git_command(command_oss, path);
+        command_oss << "commit-graph write --reachable --split=replace --changed-paths --no-progress";
+
+        if (!run(command_oss.str()))
+            return false;
+
+        std::ostringstream unset_oss;
+
+        git_command(unset_oss, path);
+        unset_oss << "config --unset-all core.alternateRefsPrefixes";
+
+        run(unset_oss.str());
+
+        const std::string file =path + "/objects/info/alternates";
+        std::ostringstream rest;
+
+        {
+            std::ifstream ifs{file};
+            std::string line;
+
+            while (getline(ifs, line))
+            {
+                if (line != pool_objects)
+                    rest << line << '\n';
+            }
+        }
+
+        if (rest.str().empty())
+            return unlink(file.c_str()) == 0;
+
+        const std::string temp =file + ".junction";
+
+        std::ofstream ofs{temp};
+        ofs << rest.str();
+
+        return ofs.flush()
+            && rename(temp.c_str(), file.c_str()) == 0;
+    }
+
+    // the members of a pool as of its last update, one path per line
+
+    static std::set<std::string> read_members(const std::string &pool)
+    {
+        std::ifstream ifs{pool + "/junction-members"};
+        std::set<std::string> members;
+        std::string line;
+
+        while (getline(ifs, line))
+            members.insert(line);
+
+        return members;
+    }
+
+    static void write_members(const std::string &pool, const std::vector<std::string> &members)
+    {
+        const std::string file =pool + "/junction-members";
+        const std::string temp =file + ".junction";
+
+        {
+            std::ofstream ofs{temp};
+
+            for (auto ptr =members.begin();
+                 ptr != members.end();
+                 ++ptr)
+            {
+                ofs << *ptr << '\n';
+            }
+
+            if (!ofs.flush())
+                throw generic_exception{"failed to write " + temp};
+        }
+
+        if (rename(temp.c_str(), file.c_str()) != 0)
+            throw stdlib_exception{"rename(" + temp + ")", errno};
+    }
+
+    // fetches the refs of the members, drops those of former members, and
+    // repacks if anything changed. Former members that still exist are
+    // unlinked first, so that their objects can be pruned.
+
+    static void update_pool(const std::string &pool, const std::vector<std::string> &members)
+    {
+        const std::string pool_objects =pool + "/objects";
+
+        bool prune =false;
+
+        {
+            const std::set<std::string> current{members.begin(), members.end()};
+            const std::set<std::string> former =read_members(pool);
+
+            bool unlinked =true;
+
+            for (auto ptr =former.begin();
+                 ptr != former.end();
+                 ++ptr)
+            {
+                if (current.count(*ptr) != 0)
+                    continue;
+
+                prune =true;
+
+                if (linked(*ptr, pool_objects)
+                    && !leave(*ptr, pool_objects))
+                {
+                    std::cerr << "junction-maint: failed to unlink " << *ptr << " from " << pool << "\n";
+                    unlinked =false;
+                }
+            }
+
+            prune =prune && unlinked;
+        }
+
+        std::ostringstream refs_oss;
+
+        git_command(refs_oss, pool);
+        refs_oss << "for-each-ref --format='%(objectname) %(refname)' refs/remotes/";
+
+        const std::string refs_before =output(refs_oss.str());
+
+        std::set<std::string> ids;
+
+        for (auto ptr =members.begin();
+             ptr != members.end();
+             ++ptr)
+        {
+            const std::string id =member_id(*ptr);
+
+            ids.insert(id);
+
+            std::ostringstream command_oss;
+            escape_bash escape{command_oss};
+
+            git_command(command_oss, pool);
+            command_oss << "fetch --quiet --prune --no-tags --no-write-fetch-head ";
+            escape << *ptr;
+            command_oss << " '+refs/*:refs/remotes/" << id << "/*'";
+
+            if (!run(command_oss.str()))
+                std::cerr << "junction-maint: failed to fetch " << *ptr << " into " << pool << "\n";
+        }
+
+        {
+            std::istringstream iss{refs_before};
+            std::ostringstream deletes;
+            std::string oid, ref;
+
+            while (iss >> oid >> ref)
+            {
+                // refs/remotes/<id>/...
+
+                const std::string id =ref.substr(13, ref.find('/', 13) - 13);
+
+                if (ids.count(id) == 0)
+                    deletes << "delete " << ref << '\n';
+            }
+
+            if (!deletes.str().empty())
+            {
+                std::ostringstream command_oss;
+
+                git_command(command_oss, pool);
+                command_oss << "update-ref --stdin";
+
+                process_io process{command_oss.str()};
+                process.write() << deletes.str();
+                process.close_write();
+
+                // until it exits
+                process.read().ignore(std::numeric_limits<std::streamsize>::max());
+            }
+        }
+
+        write_members(pool, members);
+
+        if (output(refs_oss.str()) == refs_before)
+            return;
+
+        // the objects the refs of a member no longer reach are kept while
+        // it is linked: it may have got new objects depending on them since
+        // the fetch. Once a member has left, nothing borrows them.
+
+        std::ostringstream command_oss;
+
+        git_command(command_oss, pool);
+        command_oss << "repack -a -d -q --write-bitmap-index" << (prune ? " && " : " -k && ");
+
+        if (prune)
+        {
+            git_command(command_oss, pool);
+            command_oss << "prune --expire=2.weeks.ago && ";
+        }
+
+        git_command(command_oss, pool);
+        command_oss << "commit-graph write --reachable " << (prune ? "--split=replace" : "--split") << " --changed-paths --no-progress";
+
+        if (!run(command_oss.str()))
+            std::cerr << "junction-maint: failed to repack " << pool << "\n";
+    }
+}
+
+// *********************************************************
+
+unsigned int object_pools::update()
+{
+    groups_t groups;
+
+    for_each_git_dir(root_scanner(roots, groups));
+
+    // the members of pools that lost all but one, or all of them, leave too
+
+    {
+        opendir_raii dir{config::pool_path};
+        struct dirent *dirent;
+
+        while ((dirent =dir.readdir()))
+        {
+            const std::string name =dirent->d_name;
+
+            if (name.size() > 4
+                && name.compare(name.size() - 4, 4, ".git") == 0)
+            {
+                groups[name.substr(0, name.size() - 4)];
+            }
+        }
+    }
+
+    unsigned int count =0;
+
+    for (auto group =groups.begin();
+         group != groups.end();
+         ++group)
+    {
+        const std::string pool =config::pool_path + '/' + group->first + ".git";
+        const std::string pool_objects =pool + "/objects";
+
+        struct stat st;
+
+        if (stat(pool.c_str(), &st) != 0)
+        {
+            if (group->second.size() < 2)
+                continue;
+
+            create_pool(pool);
+        }
+        else if (group->second.size() < 2)
+        {
+            update_pool(pool, std::vector<std::string>{});
+            continue;
+        }
+
+        update_pool(pool, group->second);
+
+        for (auto ptr =group->second.begin();
+             ptr != group->second.end();
+             ++ptr)
+        {
+            if (!linked(*ptr, pool_objects)) {
+                link(*ptr, pool_objects);
+                ++count;
+            }
+        }
+    }
+
+    return count;
+}
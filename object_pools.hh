@@ -0,0 +1,48 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_OBJECT_POOLS_HEADER
+#define GIT_JUNCTION_OBJECT_POOLS_HEADER
+
+#include <map>
+#include <string>
+
+// Stores the objects shared by related repositories once, in a pool
+// repository under config::pool_path that they borrow from through
+// objects/info/alternates. Repositories are related when the first-parent
+// history of their HEAD starts from the same root commit, which forks and
+// mirrors of the same origin have in common; every such group of two or
+// more gets a pool named after the root. Only repositories of the same
+// owner share a pool, except public ones, which share one of their own.
+//
+// The pool fetches the refs of each member into refs/remotes/<member>/,
+// where <member> is the hash of its path, and packs them with delta
+// islands (pack.island), so that a member's objects still delta against
+// each other and fetches from it can reuse them. Members are linked once
+// their objects are in the pool, and repacked to drop the objects they now
+// borrow; core.alternateRefsPrefixes limits the refs of the pool they
+// advertise to their own. Unreachable objects are kept, as a member may
+// have got new objects depending on them in the meantime, until a member
+// leaves: it takes back the objects it borrows and the pool is pruned.
+
+class object_pools {
+public:
+    // root commit of a repository as of a fingerprint of its refs (see
+    // ref_state.hh): a force-push or a new HEAD can change it
+    struct root {
+        std::string ref_state;
+        std::string commit;
+    };
+
+private:
+    std::map<std::string, root> roots;
+
+public:
+    // returns the number of repositories newly linked to a pool
+    unsigned int update();
+};
+
+#endif
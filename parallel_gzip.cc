@@ -0,0 +1,243 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "parallel_gzip.hh"
+#include "exception.hh"
+
+#include <algorithm>
+
+#include <zlib.h>
+
+//
+
+namespace
+{
+    // no file name, no time, unix
+
+    static const char gzip_header[10] {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+
+    // an empty final block, ending the deflate stream
+    static const char final_block[2] {3, 0};
+
+    static void put_le32(std::string &out, uint32_t value)
+    {
+        for (unsigned int i =0; i < 4; ++i)
+            out += static_cast<char>((value >> (i * 8)) & 0xff);
+    }
+}
+
+// *********************************************************
+
+parallel_gzip::parallel_gzip(unsigned int threads, int l, const sink_t &s)
+    : level{l},
+      sink{s},
+      max_pending{threads * 2},
+      started{false},
+      crc{static_cast<uint32_t>(crc32(0, Z_NULL, 0))},
+      size{0},
+      stopping{false}
+{
+    for (unsigned int i =0; i < threads; ++i)
+        workers.emplace_back(&parallel_gzip::work, this);
+}
+
+parallel_gzip::~parallel_gzip()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping =true;
+    }
+
+    work_cv.notify_all();
+
+    for (auto ptr =workers.begin();
+         ptr != workers.end();
+         ++ptr)
+    {
+        ptr->join();
+    }
+}
+
+void parallel_gzip::work()
+{
+    for (;;)
+    {
+        job *j;
+
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+
+            work_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+
+            if (stopping)
+                return;
+
+            j =queue.front();
+            queue.pop_front();
+        }
+
+        compress(*j, level);
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            j->done =true;
+        }
+
+        done_cv.notify_all();
+    }
+}
+
+// raw deflate, ending in a sync flush so that the next block starts on a
+// byte boundary
+
+void parallel_gzip::compress(job &j, int level)
+{
+    j.crc =crc32(0, reinterpret_cast<const Bytef *>(j.input.data()), j.input.size());
+
+    z_stream zs {};
+
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        j.failed =true;
+        return;
+    }
+
+    if (!j.dictionary.empty()
+        && deflateSetDictionary(&zs,
+                                reinterpret_cast<const Bytef *>(j.dictionary.data()),
+                                j.dictionary.size()) != Z_OK)
+    {
+        deflateEnd(&zs);
+        j.failed =true;
+        return;
+    }
+
+    j.output.resize(deflateBound(&zs, j.input.size()) + 16);
+
+    zs.next_in   =reinterpret_cast<Bytef *>(const_cast<char *>(j.input.data()));
+    zs.avail_in  =j.input.size();
+    zs.next_out  =reinterpret_cast<Bytef *>(&j.output[0]);
+    zs.avail_out =j.output.size();
+
+    const int result =deflate(&zs, Z_SYNC_FLUSH);
+
+    if (result != Z_OK
+        || zs.avail_in != 0
+        || zs.avail_out == 0)   // might not have flushed everything
+    {
+        j.failed =true;
+    }
+
+    j.output.resize(j.output.size() - zs.avail_out);
+    deflateEnd(&zs);
+
+    // the input is not needed anymore
+    std::string{}.swap(j.input);
+}
+
+void parallel_gzip::start()
+{
+    if (!started) {
+        sink(gzip_header, sizeof(gzip_header));
+        started =true;
+    }
+}
+
+void parallel_gzip::submit()
+{
+    std::unique_ptr<job> j{new job{}};
+
+    j->dictionary =dictionary;
+
+    if (block.size() >= dictionary_size) {
+        dictionary.assign(block, block.size() - dictionary_size, dictionary_size);
+    }
+    else {
+        dictionary += block;
+        dictionary.erase(0, dictionary.size() - std::min<size_t>(dictionary.size(), dictionary_size));
+    }
+
+    size += block.size();
+    j->length =block.size();
+    j->input.swap(block);
+
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        queue.push_back(j.get());
+        pending.push_back(std::move(j));
+    }
+
+    work_cv.notify_one();
+}
+
+// writes finished blocks in order, waiting until at most 'keep' are left
+
+void parallel_gzip::drain(size_t keep)
+{
+    for (;;)
+    {
+        std::unique_ptr<job> j;
+
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+
+            if (pending.empty())
+                return;
+
+            if (!pending.front()->done)
+            {
+                if (pending.size() <= keep)
+                    return;
+
+                done_cv.wait(lock, [this] { return pending.front()->done; });
+            }
+
+            j =std::move(pending.front());
+            pending.pop_front();
+        }
+
+        if (j->failed)
+            throw generic_exception{"deflate failed"};
+
+        crc =crc32_combine(crc, j->crc, j->length);
+
+        start();
+        sink(j->output.data(), j->output.size());
+    }
+}
+
+void parallel_gzip::write(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        const size_t part =std::min(length, block_size - block.size());
+
+        block.append(data, part);
+        data += part;
+        length -= part;
+
+        if (block.size() == block_size) {
+            submit();
+            drain(max_pending);
+        }
+    }
+}
+
+void parallel_gzip::finish()
+{
+    if (!block.empty())
+        submit();
+
+    drain(0);
+    start();
+
+    std::string trailer{final_block, sizeof(final_block)};
+
+    put_le32(trailer, crc);
+    put_le32(trailer, static_cast<uint32_t>(size));
+
+    sink(trailer.data(), trailer.size());
+}
@@ -0,0 +1,90 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_PARALLEL_GZIP_HEADER
+#define GIT_JUNCTION_PARALLEL_GZIP_HEADER
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// gzip compression on a pool of threads, in the way of pigz: the input is
+// cut into blocks, and every block is deflated on its own with the end of
+// the previous block as the dictionary, ending in a sync flush. The blocks
+// are written out in order as one gzip member, whose CRC is combined from
+// the CRCs of the blocks, so the result is an ordinary .gz file.
+
+class parallel_gzip {
+public:
+    typedef std::function<void (const char *, size_t)> sink_t;
+
+    enum {
+        default_level   =6,     // as git's and gzip's
+        block_size      =128 * 1024,
+        dictionary_size =32 * 1024,
+    };
+
+private:
+    struct job {
+        std::string input;
+        std::string dictionary;
+        std::string output;
+        size_t length;          // of the input
+        uint32_t crc;
+        bool done;
+        bool failed;
+    };
+
+    const int level;
+    const sink_t sink;
+    const size_t max_pending;
+
+    std::string block;
+    std::string dictionary;
+
+    bool started;               // the gzip header is written with the first block
+    uint32_t crc;
+    uint64_t size;
+
+    std::deque<std::unique_ptr<job>> pending;      // in output order
+    std::deque<job *> queue;                       // not yet started
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    bool stopping;
+
+    std::vector<std::thread> workers;
+
+    void work();
+    static void compress(job &, int level);
+
+    void start();
+    void submit();
+    void drain(size_t keep);
+
+public:
+    parallel_gzip(unsigned int threads, int level, const sink_t &);
+    ~parallel_gzip();
+
+    parallel_gzip(const parallel_gzip &) =delete;
+    parallel_gzip &operator= (const parallel_gzip &) =delete;
+
+    void write(const char *data, size_t size);
+
+    // writes the rest, the last block and the gzip trailer
+    void finish();
+};
+
+#endif
@@ -0,0 +1,158 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "pkt_line.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+//
+
+namespace
+{
+    static int hex_value(char ch)
+    {
+        switch (ch) {
+        case '0' ... '9': return ch - '0';
+        case 'a' ... 'f': return ch - 'a' + 10;
+        case 'A' ... 'F': return ch - 'A' + 10;
+        default:          return -1;
+        }
+    }
+}
+
+// *********************************************************
+
+pkt_line_reader::pkt_line_reader(int f)
+    : fd{f},
+      begin{0},
+      end{0}
+{
+}
+
+bool pkt_line_reader::fill(size_t wanted)
+{
+    if (end - begin >= wanted)
+        return true;
+
+    if (begin > 0) {
+        memmove(buffer, buffer + begin, end - begin);
+        end -= begin;
+        begin =0;
+    }
+
+    while (end < wanted)
+    {
+        const ssize_t result =::read(fd, buffer + end, sizeof(buffer) - end);
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (result == 0)
+            return false;
+
+        end += result;
+    }
+
+    return true;
+}
+
+bool pkt_line_reader::read(std::string &raw)
+{
+    if (!fill(4)) {
+        if (end == begin)
+            return false;
+        throw generic_exception{"truncated pkt-line"};
+    }
+
+    size_t size =0;
+
+    for (unsigned int i =0; i < 4; ++i)
+    {
+        const int digit =hex_value(buffer[begin + i]);
+
+        if (digit < 0)
+            throw generic_exception{"invalid pkt-line header"};
+
+        size =(size << 4) | digit;
+    }
+
+    if (size < 4)
+        size =4;                // flush, delim, response-end
+    else if (size > pkt_line::max_size + 4)
+        throw generic_exception{"invalid pkt-line size"};
+
+    if (!fill(size))
+        throw generic_exception{"truncated pkt-line"};
+
+    raw.assign(buffer + begin, size);
+    begin += size;
+
+    return true;
+}
+
+std::string pkt_line_reader::take_buffered()
+{
+    std::string result{buffer + begin, end - begin};
+
+    begin =end =0;
+    return result;
+}
+
+// *********************************************************
+
+const std::string pkt_line::flush {"0000"};
+const std::string pkt_line::delim {"0001"};
+
+std::string pkt_line::encode(const std::string &payload)
+{
+    static const char hex[] ="0123456789abcdef";
+
+    const size_t size =payload.size() + 4;
+
+    if (size > max_size + 4)
+        throw generic_exception{"pkt-line payload too long"};
+
+    std::string raw;
+    raw.reserve(size);
+
+    raw += hex[(size >> 12) & 0xf];
+    raw += hex[(size >> 8) & 0xf];
+    raw += hex[(size >> 4) & 0xf];
+    raw += hex[size & 0xf];
+    raw += payload;
+
+    return raw;
+}
+
+bool pkt_line::is_flush(const std::string &raw)
+{
+    return raw == flush;
+}
+
+bool pkt_line::is_delim(const std::string &raw)
+{
+    return raw == delim;
+}
+
+std::string pkt_line::text(const std::string &raw)
+{
+    if (raw.size() <= 4)
+        return std::string{};
+
+    std::string::size_type size =raw.size() - 4;
+
+    if (raw[raw.size() - 1] == '\n')
+        --size;
+
+    return raw.substr(4, size);
+}
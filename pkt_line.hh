@@ -0,0 +1,57 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_PKT_LINE_HEADER
+#define GIT_JUNCTION_PKT_LINE_HEADER
+
+#include <string>
+#include <cstddef>
+
+// git pkt-line framing: four hex digits of length (including themselves)
+// followed by the payload. "0000" is flush, "0001" delim and "0002"
+// response-end.
+
+class pkt_line_reader {
+    const int fd;
+
+    char buffer[65536];
+    size_t begin;
+    size_t end;
+
+    bool fill(size_t wanted);
+
+public:
+    pkt_line_reader(int fd);
+
+    // reads one packet, header included, into 'raw'; returns false on a
+    // clean EOF between packets and throws generic_exception on garbage
+    bool read(std::string &raw);
+
+    // bytes read from the fd but not yet returned as packets
+    std::string take_buffered();
+};
+
+// *****
+
+namespace pkt_line
+{
+    enum {
+        max_size =65520,
+    };
+
+    std::string encode(const std::string &payload);
+
+    extern const std::string flush;
+    extern const std::string delim;
+
+    bool is_flush(const std::string &raw);
+    bool is_delim(const std::string &raw);
+
+    // payload without the header and a trailing newline
+    std::string text(const std::string &raw);
+}
+
+#endif
@@ -0,0 +1,308 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "access_map.hh"
+#include "activity_table.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reads the pack indexes, reverse indexes, bitmaps, multi-pack-indexes and
+// commit-graphs of the most recently used repositories into the page cache,
+// e.g. after a reboot, so that their first fetches don't wait for the
+// disk. Repositories are ranked by their latest git command in the
+// activity table, or by the modification time of their packs when they
+// have none. The files of a repository are read only if all of them fit in
+// what is left of config::prewarm_budget_mib, smaller repositories further
+// down the list may still fit. The objects of an object pool (see
+// object_pools.hh) count towards the first repository borrowing them.
+
+namespace
+{
+    struct repository {
+        std::string path;
+        time_t used;
+    };
+
+    // modification time, 0 if the file does not exist
+
+    static time_t mtime(const std::string &file)
+    {
+        struct stat st;
+
+        if (stat(file.c_str(), &st) != 0)
+            return 0;
+
+        return st.st_mtime;
+    }
+
+    static bool has_suffix(const char *name, const char *suffix)
+    {
+        const size_t size =strlen(name);
+        const size_t suffix_size =strlen(suffix);
+
+        return size >= suffix_size
+            && strcmp(name + size - suffix_size, suffix) == 0;
+    }
+
+    // appends the regular files of a directory that pass 'wanted'
+
+    template<class wanted_t>
+    static void add_files(std::vector<std::string> &files, const std::string &dir, wanted_t wanted)
+    {
+        try {
+            opendir_raii d{dir};
+            struct dirent *dirent;
+
+            while ((dirent =d.readdir()))
+            {
+                if (dirent->d_name[0] != '.'
+                    && wanted(dirent->d_name))
+                {
+                    files.push_back(dir + '/' + dirent->d_name);
+                }
+            }
+        }
+        catch (stdlib_exception) {
+        }
+    }
+
+    // the object directory of a repository and those it borrows from
+
+    static std::vector<std::string> object_dirs(const std::string &path)
+    {
+        std::vector<std::string> result{path + "/objects"};
+
+        std::ifstream ifs{path + "/objects/info/alternates"};
+        std::string line;
+
+        while (std::getline(ifs, line))
+        {
+            if (line.empty()
+                || line[0] == '#')
+            {
+                continue;
+            }
+
+            result.push_back(line[0] == '/' ? line : path + "/objects/" + line);
+        }
+
+        return result;
+    }
+
+    static std::vector<std::string> index_files(const std::string &objects)
+    {
+        std::vector<std::string> files;
+
+        add_files(files, objects + "/pack", [](const char *name) {
+                return has_suffix(name, ".idx")
+                    || has_suffix(name, ".rev")
+                    || has_suffix(name, ".bitmap")
+                    || strncmp(name, "multi-pack-index", 16) == 0;
+            });
+
+        add_files(files, objects + "/info", [](const char *name) {
+                return strcmp(name, "commit-graph") == 0;
+            });
+
+        add_files(files, objects + "/info/commit-graphs", [](const char *name) {
+                return has_suffix(name, ".graph");
+            });
+
+        return files;
+    }
+
+    class repository_scanner : public git_dir_functor {
+        const activity_table *table;
+        std::vector<repository> &result;
+
+    public:
+        repository_scanner(const activity_table *t, std::vector<repository> &r)
+            : table{t}, result(r) {}
+
+        virtual void operator() (const std::string &path) const
+        {
+            time_t used =0;
+
+            if (table)
+            {
+                const activity_table::slot *s =table->find(access_map::hash(path.data(), path.size()), path);
+
+                if (s)
+                    used =__atomic_load_n(&s->last_access, __ATOMIC_RELAXED);
+            }
+
+            if (used == 0)
+                used =mtime(path + "/objects/pack");
+
+            result.push_back(repository{path, used});
+        }
+    };
+
+    // asks the kernel to read the file in the background; O_NOATIME is
+    // only allowed to the owner of the file
+
+    static bool prewarm(const std::string &file)
+    {
+        int fd =open(file.c_str(), O_RDONLY | O_NOATIME | O_CLOEXEC);
+
+        if (fd < 0
+            && errno == EPERM)
+        {
+            fd =open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+
+        if (fd < 0)
+            return false;
+
+        const int error =posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+
+        return error == 0;
+    }
+}
+
+// *********************************************************
+
+int main(int argc, char *argv[])
+{
+    enum {
+        return_ok =0,
+        return_usage_error,
+        return_stdlib_error,
+        return_generic_error,
+    };
+
+    const bool verbose =(argc == 2 && std::string{argv[1]} == "-v");
+
+    if (argc > 2
+        || (argc == 2 && !verbose))
+    {
+        std::cerr << "usage: junction-prewarm [-v]\n";
+        return return_usage_error;
+    }
+
+    try {
+        std::unique_ptr<activity_table> table;
+
+        try {
+            table.reset(new activity_table{false});
+        }
+        catch (stdlib_exception) {
+            // no git command recorded since the reboot
+        }
+
+        std::vector<repository> repositories;
+
+        for_each_git_dir(repository_scanner{table.get(), repositories});
+
+        std::stable_sort(repositories.begin(), repositories.end(),
+                         [](const repository &a, const repository &b) { return a.used > b.used; });
+
+        const uint64_t budget =uint64_t{config::prewarm_budget_mib} << 20;
+        uint64_t total =0;
+        std::set<std::string> seen;
+        unsigned int count =0;
+
+        for (auto repo =repositories.begin();
+             repo != repositories.end() && total < budget;
+             ++repo)
+        {
+            std::vector<std::string> files;
+            std::vector<uint64_t> sizes;
+            uint64_t size =0;
+
+            const std::vector<std::string> dirs =object_dirs(repo->path);
+
+            for (auto dir =dirs.begin();
+                 dir != dirs.end();
+                 ++dir)
+            {
+                const std::vector<std::string> dir_files =index_files(*dir);
+
+                for (auto file =dir_files.begin();
+                     file != dir_files.end();
+                     ++file)
+                {
+                    struct stat st;
+
+                    if (seen.count(*file) != 0
+                        || stat(file->c_str(), &st) != 0
+                        || !S_ISREG(st.st_mode))
+                    {
+                        continue;
+                    }
+
+                    files.push_back(*file);
+                    sizes.push_back(st.st_size);
+                    size += st.st_size;
+                }
+            }
+
+            if (files.empty()
+                || total + size > budget)
+            {
+                continue;
+            }
+
+            unsigned int advised =0;
+            uint64_t advised_size =0;
+
+            for (size_t i =0; i < files.size(); ++i)
+            {
+                seen.insert(files[i]);
+
+                if (!prewarm(files[i]))
+                    continue;
+
+                ++advised;
+                advised_size += sizes[i];
+            }
+
+            total += advised_size;
+
+            if (advised != 0)
+                ++count;
+
+            if (verbose) {
+                std::cout << repo->path << ": " << advised << " files, " << (advised_size >> 10) << " KiB";
+
+                if (advised != files.size())
+                    std::cout << " (" << files.size() - advised << " could not be opened)";
+
+                std::cout << '\n';
+            }
+        }
+
+        if (verbose)
+            std::cout << count << " repositories, " << (total >> 20) << " MiB\n";
+    }
+    catch (generic_exception &e) {
+        std::cerr << "junction-prewarm: " << e << "\n";
+        return return_generic_error;
+    }
+    catch (stdlib_exception &e) {
+        std::cerr << "junction-prewarm: " << e << "\n";
+        return return_stdlib_error;
+    }
+
+    return return_ok;
+}
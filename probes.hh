@@ -0,0 +1,90 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_PROBES_HEADER
+#define GIT_JUNCTION_PROBES_HEADER
+
+#include <cstdint>
+
+// USDT probes (provider "git_junction") for bpftrace and perf, e.g.
+//
+//   bpftrace -e 'usdt:/home/git/bin/junction-shell:git_junction:exec
+//                { printf("%s %s %d us\n", str(arg0), str(arg1), arg5 / 1000); }'
+//
+// They are built in whenever <sys/sdt.h> (systemtap-sdt-dev) is available,
+// unless -DGIT_JUNCTION_NO_PROBES is in CONFIGURATION_FLAGS. Each probe is
+// a single nop plus an ELF note, so it costs nothing until attached apart
+// from its arguments. Without probes the macros expand to nothing and
+// their arguments, durations included, are never evaluated.
+//
+// Probes, with arguments (strings are char pointers, durations nanoseconds):
+//
+//   junction-shell
+//     connection_start   user, command line
+//     authorize          user, path, allowed (0/1), duration since start
+//     exec               user, path, command, how ("exec", "relay",
+//                        "upload-pack proxy", "upload-archive proxy"),
+//                        admission duration, duration since start
+//   junction-console
+//     git_dirs_start     directory
+//     git_dirs_done      directory, duration
+//     spawn              command line, pid
+//     key_install        user, exit status, duration
+//   both
+//     cgitrc_import      file, found (0/1), duration
+
+#if !defined(GIT_JUNCTION_PROBES) && !defined(GIT_JUNCTION_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define GIT_JUNCTION_PROBES
+#endif
+#endif
+
+#ifdef GIT_JUNCTION_PROBES
+
+#include <sys/sdt.h>
+#include <time.h>
+
+#define PROBE1(name, a)                   DTRACE_PROBE1(git_junction, name, a)
+#define PROBE2(name, a, b)                DTRACE_PROBE2(git_junction, name, a, b)
+#define PROBE3(name, a, b, c)             DTRACE_PROBE3(git_junction, name, a, b, c)
+#define PROBE4(name, a, b, c, d)          DTRACE_PROBE4(git_junction, name, a, b, c, d)
+#define PROBE6(name, a, b, c, d, e, f)    DTRACE_PROBE6(git_junction, name, a, b, c, d, e, f)
+
+class probe_timer {
+    uint64_t start;
+
+    static uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+public:
+    probe_timer() : start{now()} {}
+
+    uint64_t elapsed() const { return now() - start; }
+};
+
+#else
+
+// 'if (false)' keeps the arguments used, without evaluating them
+
+#define PROBE1(name, a)                   do { if (false) { (void)(a); } } while (0)
+#define PROBE2(name, a, b)                do { if (false) { (void)(a); (void)(b); } } while (0)
+#define PROBE3(name, a, b, c)             do { if (false) { (void)(a); (void)(b); (void)(c); } } while (0)
+#define PROBE4(name, a, b, c, d)          do { if (false) { (void)(a); (void)(b); (void)(c); (void)(d); } } while (0)
+#define PROBE6(name, a, b, c, d, e, f)    do { if (false) { (void)(a); (void)(b); (void)(c); (void)(d); (void)(e); (void)(f); } } while (0)
+
+class probe_timer {
+public:
+    uint64_t elapsed() const { return 0; }
+};
+
+#endif
+
+#endif
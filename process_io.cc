@@ -7,6 +7,7 @@
 #include "process_io.hh"
 #include "config.hh"
 #include "exception.hh"
+#include "probes.hh"
 
 #include <sstream>
 #include <unistd.h>
@@ -79,6 +80,8 @@ namespace
 
         // parent
 
+        PROBE2(spawn, argv0.c_str(), pid);
+
         close(fds_read[1]);
         close(fds_write[0]);
 
@@ -0,0 +1,59 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "ref_format.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "ref_lock.hh"
+#include "utils.hh"
+
+#include <sstream>
+
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//
+
+bool ref_format::is_reftable(const std::string &path)
+{
+    struct stat st;
+
+    return stat((path + "/reftable").c_str(), &st) == 0
+        && S_ISDIR(st.st_mode);
+}
+
+bool ref_format::migrate(const std::string &path, bool reftable)
+{
+    try {
+        ref_lock lock{path.c_str()};
+
+        if (!lock.try_lock_exclusive())
+            return false;
+
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        command_oss << "git --git-dir=";
+        escape << path;
+        command_oss << " refs migrate --ref-format=" << (reftable ? "reftable" : "files");
+
+        const int status =system(command_oss.str().c_str());
+
+        return status != -1
+            && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+    }
+    catch (stdlib_exception) {
+        return false;
+    }
+}
+
+const char *ref_format::init_option()
+{
+    return config::reftable_new_repositories ? "--ref-format=reftable " : "";
+}
@@ -0,0 +1,33 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_REF_FORMAT_HEADER
+#define GIT_JUNCTION_REF_FORMAT_HEADER
+
+#include <string>
+
+// The ref storage backend of a repository. With reftable (git 2.45 or
+// later, migrating needs 2.46), a push appends a small table instead of
+// rewriting packed-refs, which matters once a repository has a lot of
+// refs. The cgitrc word "reftable" asks for it; junction-maint migrates
+// repositories that have it but still store their refs in files.
+//
+// Migrating is not safe against concurrent ref updates, so it holds the
+// repository's ref_lock, which pushes wait for.
+
+class ref_format {
+public:
+    static bool is_reftable(const std::string &path);
+
+    // false if git failed, e.g. when it is too old, or a push is in progress
+    static bool migrate(const std::string &path, bool reftable);
+
+    // the option of git init and git clone that creates new repositories
+    // as config::reftable_new_repositories says, with a trailing space
+    static const char *init_option();
+};
+
+#endif
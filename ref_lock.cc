@@ -0,0 +1,77 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "ref_lock.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+//
+
+ref_lock::ref_lock(const char *path)
+{
+    char file[PATH_MAX];
+    const int size =snprintf(file, sizeof(file), "%s/junction-ref-lock", path);
+
+    if (size < 0
+        || static_cast<size_t>(size) >= sizeof(file))
+    {
+        throw stdlib_exception{std::string{"snprintf("} + path + ")", ENAMETOOLONG};
+    }
+
+    fd =open(file, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+        throw stdlib_exception{std::string{"open("} + file + ")", errno};
+}
+
+ref_lock::~ref_lock()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool ref_lock::try_lock_shared()
+{
+    if (flock(fd, LOCK_SH | LOCK_NB) == 0)
+        return true;
+
+    if (errno != EWOULDBLOCK)
+        throw stdlib_exception{"flock()", errno};
+
+    return false;
+}
+
+bool ref_lock::try_lock_exclusive()
+{
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+        return true;
+
+    if (errno != EWOULDBLOCK)
+        throw stdlib_exception{"flock()", errno};
+
+    return false;
+}
+
+void ref_lock::lock_shared()
+{
+    while (flock(fd, LOCK_SH) != 0)
+    {
+        if (errno != EINTR)
+            throw stdlib_exception{"flock()", errno};
+    }
+}
+
+void ref_lock::keep()
+{
+    fd =-1;
+}
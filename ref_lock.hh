@@ -0,0 +1,37 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_REF_LOCK_HEADER
+#define GIT_JUNCTION_REF_LOCK_HEADER
+
+// flock() on <repository>/junction-ref-lock. junction-shell holds it shared
+// while it waits for git-receive-pack, and ref_format::migrate()
+// holds it exclusively: a migration doesn't start during a push, and pushes
+// wait until it has finished. The kernel releases the lock of a crashed
+// process.
+
+class ref_lock {
+    int fd;
+
+public:
+    // throws stdlib_exception; no heap unless it does
+    explicit ref_lock(const char *path);
+    ~ref_lock();
+
+    ref_lock(const ref_lock &) =delete;
+    ref_lock &operator= (const ref_lock &) =delete;
+
+    // return false if the lock is held the other way
+    bool try_lock_shared();
+    bool try_lock_exclusive();
+
+    void lock_shared();
+
+    // the lock stays held by this process after the object is gone
+    void keep();
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "ref_state.hh"
+
+#include <sstream>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+//
+
+namespace
+{
+    // false if the file is racy or stat() fails for another reason than
+    // the file not existing
+
+    static bool add_file(std::ostringstream &oss, const std::string &file, time_t now, struct stat &st)
+    {
+        if (stat(file.c_str(), &st) != 0)
+        {
+            st.st_mode =0;
+
+            if (errno != ENOENT)
+                return false;
+
+            oss << file << " -\n";
+            return true;
+        }
+
+        if (st.st_mtim.tv_sec + racy_seconds >= now
+            || st.st_ctim.tv_sec + racy_seconds >= now)
+        {
+            return false;
+        }
+
+        oss << file << ' ' << st.st_ino << ' ' << st.st_size
+            << ' ' << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec
+            << ' ' << st.st_ctim.tv_sec << '.' << st.st_ctim.tv_nsec << '\n';
+
+        return true;
+    }
+
+    static bool add_tree(std::ostringstream &oss, const std::string &dir_path, time_t now)
+    {
+        struct stat st;
+
+        if (!add_file(oss, dir_path, now, st))
+            return false;
+
+        if (!S_ISDIR(st.st_mode))
+            return true;
+
+        DIR *dir =opendir(dir_path.c_str());
+
+        if (!dir)
+            return false;
+
+        bool result =true;
+
+        while (const struct dirent *de =readdir(dir))
+        {
+            if (strcmp(de->d_name, ".") == 0
+                || strcmp(de->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            if (!(result =add_tree(oss, dir_path + '/' + de->d_name, now)))
+                break;
+        }
+
+        closedir(dir);
+        return result;
+    }
+}
+
+// *********************************************************
+
+bool ref_state_fingerprint(const std::string &path, std::string &fingerprint)
+{
+    const time_t now =time(nullptr);
+
+    std::ostringstream oss;
+    struct stat st;
+
+    if (!add_file(oss, path + "/HEAD", now, st)
+        || !add_file(oss, path + "/packed-refs", now, st)
+        || !add_file(oss, path + "/config", now, st)
+        || !add_file(oss, path + "/reftable/tables.list", now, st)
+        || !add_tree(oss, path + "/refs", now))
+    {
+        return false;
+    }
+
+    fingerprint =oss.str();
+    return true;
+}
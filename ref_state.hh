@@ -0,0 +1,29 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_REF_STATE_HEADER
+#define GIT_JUNCTION_REF_STATE_HEADER
+
+#include <string>
+
+// Fingerprint of the refs of a repository, from stat() data only: HEAD,
+// packed-refs, config, reftable/tables.list and every file and directory
+// under refs/. git replaces a ref by renaming a lock file over it, so any
+// change shows up as a new inode, size or time.
+//
+// File times have a coarse granularity, so two updates close together
+// could leave identical data behind. Like git's racily clean index
+// entries, a state with anything modified within racy_seconds has no
+// fingerprint, and the caller must not cache it.
+
+enum {
+    racy_seconds =1,
+};
+
+// returns false if the state is racy or can't be read
+bool ref_state_fingerprint(const std::string &path, std::string &fingerprint);
+
+#endif
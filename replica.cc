@@ -0,0 +1,200 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "replica.hh"
+#include "config.hh"
+#include "shell_stats.hh"
+
+#include <fstream>
+#include <map>
+
+#include <cstring>
+#include <ctime>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+//
+
+namespace
+{
+    struct ref {
+        std::string value;
+        time_t changed;
+    };
+
+    typedef std::map<std::string, ref> refs_t;
+
+    static bool read_line(const std::string &file, std::string &line)
+    {
+        std::ifstream ifs{file};
+
+        return ifs
+            && getline(ifs, line);
+    }
+
+    // 'newest' is the newest change seen, deletions included
+
+    static bool add_loose_refs(refs_t &refs, const std::string &path, const std::string &name, time_t &newest)
+    {
+        DIR *dir =opendir((path + '/' + name).c_str());
+
+        if (!dir)
+            return false;
+
+        bool result =true;
+
+        while (const struct dirent *de =readdir(dir))
+        {
+            const size_t size =strlen(de->d_name);
+
+            if (de->d_name[0] == '.'
+                || (size > 5 && strcmp(de->d_name + size - 5, ".lock") == 0))
+            {
+                continue;
+            }
+
+            const std::string next_name =name + '/' + de->d_name;
+            const std::string next =path + '/' + next_name;
+
+            struct stat st;
+
+            if (stat(next.c_str(), &st) != 0) {
+                result =false;
+                break;
+            }
+
+            if (st.st_mtime > newest)
+                newest =st.st_mtime;
+
+            if (S_ISDIR(st.st_mode)) {
+                result =add_loose_refs(refs, path, next_name, newest);
+            }
+            else {
+                ref &r =refs[next_name];
+                r.changed =st.st_mtime;
+                result =read_line(next, r.value);
+            }
+
+            if (!result)
+                break;
+        }
+
+        closedir(dir);
+        return result;
+    }
+
+    static bool read_refs(const std::string &path, refs_t &refs, time_t &newest)
+    {
+        struct stat st;
+
+        if (stat((path + "/reftable").c_str(), &st) == 0
+            || stat((path + "/HEAD").c_str(), &st) != 0
+            || !read_line(path + "/HEAD", refs["HEAD"].value))
+        {
+            return false;
+        }
+
+        refs["HEAD"].changed =st.st_mtime;
+        newest =st.st_mtime;
+
+        // packed first, loose refs override them
+
+        const std::string packed_refs =path + "/packed-refs";
+
+        if (stat(packed_refs.c_str(), &st) == 0)
+        {
+            std::ifstream ifs{packed_refs};
+            std::string line;
+
+            while (getline(ifs, line))
+            {
+                const std::string::size_type space =line.find(' ');
+
+                if (line.empty()
+                    || line[0] == '#'
+                    || line[0] == '^'
+                    || space == std::string::npos)
+                {
+                    continue;
+                }
+
+                ref &r =refs[line.substr(space + 1)];
+                r.value   =line.substr(0, space);
+                r.changed =st.st_mtime;
+            }
+
+            if (ifs.bad())
+                return false;
+
+            if (st.st_mtime > newest)
+                newest =st.st_mtime;
+        }
+
+        return add_loose_refs(refs, path, "refs", newest);
+    }
+}
+
+// *********************************************************
+
+std::string replica::route(const std::string &relative_path)
+{
+    const std::string replica_path =config::replica_base_path + relative_path;
+
+    refs_t primary_refs, replica_refs;
+    time_t primary_newest, replica_newest;
+
+    if (!read_refs(config::base_path + relative_path, primary_refs, primary_newest)
+        || !read_refs(replica_path, replica_refs, replica_newest))
+    {
+        return std::string{};
+    }
+
+    // the time of the oldest change the replica is missing
+
+    const time_t now =time(nullptr);
+    time_t oldest_missing =now;
+    bool differs =false;
+
+    for (auto ptr =primary_refs.begin();
+         ptr != primary_refs.end();
+         ++ptr)
+    {
+        const auto found =replica_refs.find(ptr->first);
+
+        if (found == replica_refs.end()
+            || found->second.value != ptr->second.value)
+        {
+            differs =true;
+
+            if (ptr->second.changed < oldest_missing)
+                oldest_missing =ptr->second.changed;
+        }
+    }
+
+    for (auto ptr =replica_refs.begin();
+         ptr != replica_refs.end();
+         ++ptr)
+    {
+        if (primary_refs.find(ptr->first) == primary_refs.end())
+        {
+            differs =true;
+
+            if (primary_newest < oldest_missing)
+                oldest_missing =primary_newest;
+        }
+    }
+
+    if (differs
+        && now - oldest_missing >= static_cast<time_t>(config::replica_max_lag_seconds))
+    {
+        shell_stats::increment(shell_stats::k_replica_lagging);
+        return std::string{};
+    }
+
+    shell_stats::increment(shell_stats::k_replica_fetches);
+    return replica_path;
+}
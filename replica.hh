@@ -0,0 +1,31 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_REPLICA_HEADER
+#define GIT_JUNCTION_REPLICA_HEADER
+
+#include <string>
+
+// Routing of fetches to a read replica: the same repository under
+// config::replica_base_path, kept up to date by something else (e.g. git
+// fetch --mirror or rsync after each push). The refs of both are read
+// directly, loose refs over packed-refs, and compared by value.
+//
+// A replica whose refs differ lags by the age of the oldest primary ref
+// update it doesn't have, taken from the ref's file time on the primary; a
+// ref updated twice counts from the later update. A ref deleted on the
+// primary counts from the newest change under its refs/. Repositories
+// using reftable are always served by the primary.
+
+class replica {
+public:
+    // returns the replica of 'relative_path' (as under config::base_path)
+    // if it matches the primary or lags by less than
+    // config::replica_max_lag_seconds, otherwise an empty string
+    static std::string route(const std::string &relative_path);
+};
+
+#endif
@@ -5,8 +5,13 @@
  */
 
 #include "repository_menu.hh"
+#include "access_map_builder.hh"
+#include "blob_packs.hh"
+#include "bundle_list.hh"
 #include "input.hh"
 #include "process_io.hh"
+#include "ref_format.hh"
+#include "repository_profile.hh"
 #include "utils.hh"
 #include "exception.hh"
 #include "restore_ios.hh"
@@ -41,12 +46,38 @@ public:
 
         if (input == "n"
             || input == "d"
+            || input == "c"
+            || input == "f"
             || input == "x"
             || input == "?")
         {
             return true;
         }
 
+        if (input == "b"
+            && !config::blob_pack_path.empty())
+        {
+            return true;
+        }
+
+        if (input == "u"
+            && !config::bundle_path.empty())
+        {
+            return true;
+        }
+
+        if (input == "t"
+            && config::reftable)
+        {
+            return true;
+        }
+
+        if (input == "o"
+            && !config::repository_profiles.empty())
+        {
+            return true;
+        }
+
         switch (menu.rc.get_type()) {
         case cgitrc::repo_type::shared:
             if (input == "p")
@@ -80,22 +111,6 @@ public:
 
 // *********************************************************
 
-bool repository_menu::read_publicity(const std::string &path)
-{
-    std::ostringstream command_oss;
-    escape_bash escape{command_oss};
-
-    command_oss << "git --git-dir=";
-    escape << path;
-    command_oss << " config daemon.receivepack";
-
-    process_io git_config(command_oss.str());
-    std::string line;
-
-    return git_config.read() >> line
-        && line == "true";
-}
-
 repository_menu::repository_menu(const std::string &user, const std::string &p)
     : path{p},
       rc{cgitrc::import_from_file(path + "/cgitrc")},
@@ -118,6 +133,82 @@ void repository_menu::change_description()
 
     new_rc.set_desc(read_field("new description: ", false, accept_description()));
     new_rc.export_to_file(path + "/cgitrc");
+
+    access_map_builder::rebuild();
+}
+
+void repository_menu::change_profile()
+{
+    cgitrc new_rc =rc;
+
+    new_rc.set_profile(read_profile());
+    new_rc.export_to_file(path + "/cgitrc");
+
+    repository_profile::apply(path, new_rc.get_profile());
+}
+
+void repository_menu::toggle_flag(cgitrc::flags_t f)
+{
+    cgitrc new_rc =rc;
+
+    if (rc.flag(f))
+        new_rc.clear_flag(f);
+    else
+        new_rc.set_flag(f);
+
+    new_rc.export_to_file(path + "/cgitrc");
+
+    access_map_builder::rebuild();
+}
+
+void repository_menu::toggle_blob_packs()
+{
+    toggle_flag(cgitrc::f_blob_packs);
+
+    if (rc.flag(cgitrc::f_blob_packs)) {
+        blob_packs::remove(path);
+        return;
+    }
+
+    std::cout << "packing large blobs..." << std::endl;
+
+    const unsigned int count =blob_packs::update(path);
+
+    std::cout << count << " blob(s) offloaded\n";
+}
+
+void repository_menu::toggle_bundle_uris()
+{
+    toggle_flag(cgitrc::f_bundle_uris);
+
+    if (rc.flag(cgitrc::f_bundle_uris)) {
+        bundle_list::remove(path);
+        return;
+    }
+
+    std::cout << "writing bundle..." << std::endl;
+
+    if (!bundle_list::update(path))
+        std::cout << "nothing to bundle yet\n";
+}
+
+void repository_menu::toggle_reftable()
+{
+    const bool reftable =!rc.flag(cgitrc::f_reftable);
+
+    // junction-maint migrates repositories to match the flag; in here the
+    // user sees it fail
+
+    if (ref_format::is_reftable(path) != reftable) {
+        std::cout << "migrating refs..." << std::endl;
+
+        if (!ref_format::migrate(path, reftable)) {
+            std::cout << "migration failed (a push in progress, or git older than 2.46?)\n";
+            return;
+        }
+    }
+
+    toggle_flag(cgitrc::f_reftable);
 }
 
 void repository_menu::toggle_publicity()
@@ -130,6 +221,8 @@ void repository_menu::toggle_publicity()
         command_oss << "git '--git-dir=" << path << "' config daemon.receivepack true";
 
     system(command_oss.str().c_str());
+
+    access_map_builder::rebuild();
 }
 
 bool repository_menu::run(const std::string &user, const std::string &path)
@@ -146,6 +239,36 @@ bool repository_menu::run(const std::string &user, const std::string &path)
             menu.change_description();
             return true;
         }
+        else if (selection == "o")
+        {
+            menu.change_profile();
+            return true;
+        }
+        else if (selection == "c")
+        {
+            menu.toggle_flag(cgitrc::f_upload_pack_cache);
+            return true;
+        }
+        else if (selection == "f")
+        {
+            menu.toggle_flag(cgitrc::f_coalesce_fetches);
+            return true;
+        }
+        else if (selection == "b")
+        {
+            menu.toggle_blob_packs();
+            return true;
+        }
+        else if (selection == "u")
+        {
+            menu.toggle_bundle_uris();
+            return true;
+        }
+        else if (selection == "t")
+        {
+            menu.toggle_reftable();
+            return true;
+        }
         else if (selection == "x")
         {
             return false;
@@ -191,6 +314,9 @@ std::ostream &operator<< (std::ostream &out, const repository_menu &menu)
         "|\n"
         "| description: " << menu.rc.get_desc() << "\n";
 
+    if (!config::repository_profiles.empty())
+        out << "| profile:     " << (menu.rc.get_profile().empty() ? "(none)" : menu.rc.get_profile()) << "\n";
+
     switch (menu.rc.get_type()) {
     case repo_type::shared:
         out << "| publicity:   " << (menu.publicity?"public":"private") << "\n";
@@ -223,6 +349,16 @@ std::ostream &operator<< (std::ostream &out, const repository_menu &menu)
         break;
     }
 
+    out << "| clone cache: " << (menu.rc.flag(cgitrc::f_upload_pack_cache)?"on":"off") << "\n"
+        "| coalescing:  " << (menu.rc.flag(cgitrc::f_coalesce_fetches)?"on":"off") << "\n";
+
+    if (!config::blob_pack_path.empty())
+        out << "| blob packs:  " << (menu.rc.flag(cgitrc::f_blob_packs)?"on":"off") << "\n";
+    if (!config::bundle_path.empty())
+        out << "| bundle URIs: " << (menu.rc.flag(cgitrc::f_bundle_uris)?"on":"off") << "\n";
+    if (config::reftable)
+        out << "| reftable:    " << (menu.rc.flag(cgitrc::f_reftable)?"on":"off") << "\n";
+
     out << "|\n"
         "+--->\n"
         "\n"
@@ -232,6 +368,19 @@ std::ostream &operator<< (std::ostream &out, const repository_menu &menu)
         "//N) rename / move repository\n"
         "D) change description\n";
 
+    if (!config::repository_profiles.empty())
+        out << "O) change profile (git settings)\n";
+
+    out << "C) toggle clone cache\n"
+        "F) toggle fetch coalescing\n";
+
+    if (!config::blob_pack_path.empty())
+        out << "B) toggle blob packs (large blobs over HTTP)\n";
+    if (!config::bundle_path.empty())
+        out << "U) toggle bundle URIs (clones start from bundles over HTTP)\n";
+    if (config::reftable)
+        out << "T) toggle reftable (faster pushes with many refs)\n";
+
     switch (menu.rc.get_type()) {
     case repo_type::shared:
         out << "P) toggle publicity\n";
@@ -24,10 +24,6 @@ class repository_menu {
 
     //
 
-    static bool read_publicity(const std::string &path);
-
-    // *****
-
     const std::string path;
     const cgitrc rc;
     const bool publicity;
@@ -42,7 +38,12 @@ class repository_menu {
     accept_functor get_accept_functor() const;
 
     void change_description();
+    void change_profile();
     void toggle_publicity();
+    void toggle_flag(cgitrc::flags_t);
+    void toggle_blob_packs();
+    void toggle_bundle_uris();
+    void toggle_reftable();
 
 public:
     static bool run(const std::string &user, const std::string &path);
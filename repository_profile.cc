@@ -0,0 +1,307 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "repository_profile.hh"
+#include "cgitrc.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "utils.hh"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    static const char include_file[] ="junction-profile";
+
+    typedef std::map<std::string, std::string> settings_t;
+
+    static std::string quote(const std::string &value)
+    {
+        std::string result{'"'};
+
+        for (auto ptr =value.begin();
+             ptr != value.end();
+             ++ptr)
+        {
+            if (*ptr == '"'
+                || *ptr == '\\')
+            {
+                result += '\\';
+            }
+
+            result += *ptr;
+        }
+
+        return result + '"';
+    }
+
+    // "section.name" and "section.subsection.name" in the config file format
+
+    static std::string config_text(const settings_t &settings)
+    {
+        std::ostringstream oss;
+        std::string previous;
+
+        oss << "# written by git-junction, see repository_profile.hh\n";
+
+        for (auto ptr =settings.begin();
+             ptr != settings.end();
+             ++ptr)
+        {
+            const std::string::size_type first =ptr->first.find('.');
+            const std::string::size_type last =ptr->first.rfind('.');
+
+            if (first == std::string::npos)
+                continue;
+
+            const std::string header =(first == last)
+                ? '[' + ptr->first.substr(0, first) + "]"
+                : '[' + ptr->first.substr(0, first) + ' ' + quote(ptr->first.substr(first + 1, last - first - 1)) + ']';
+
+            if (header != previous) {
+                oss << header << '\n';
+                previous =header;
+            }
+
+            oss << '\t' << ptr->first.substr(last + 1) << " = " << quote(ptr->second) << '\n';
+        }
+
+        return oss.str();
+    }
+
+    // a section of its own, which applies to every repository; "gitdir:/"
+    // stands for "gitdir:/**"
+
+    static const char include_section[] ="includeIf.gitdir:/";
+    static const char include_header[] ="[includeIf \"gitdir:/\"]";
+
+    static void git_command(std::ostringstream &command_oss, const std::string &path)
+    {
+        escape_bash escape{command_oss};
+
+        command_oss << "git --git-dir=";
+        escape << path;
+        command_oss << ' ';
+    }
+
+    // appends commands that remove the include, if any, followed by "; "
+
+    static void remove_include(std::ostringstream &command_oss, const std::string &path)
+    {
+        git_command(command_oss, path);
+        command_oss << "config --remove-section '" << include_section << "' 2>/dev/null; ";
+
+        // where earlier versions put it
+        git_command(command_oss, path);
+        command_oss << "config --unset-all include.path '^" << include_file << "$'; ";
+    }
+
+    // whether the include is in the last section of the config, so that
+    // the profile wins over the repository's own settings
+
+    static bool include_is_last(const std::string &path)
+    {
+        std::ifstream ifs{path + "/config"};
+        std::string line, last;
+
+        while (getline(ifs, line))
+        {
+            const std::string::size_type first =line.find_first_not_of(" \t");
+
+            if (first != std::string::npos
+                && line[first] == '[')
+            {
+                last =line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+            }
+        }
+
+        return last == include_header;
+    }
+
+    static bool config_includes(const std::string &path)
+    {
+        std::ifstream ifs{path + "/config"};
+        std::string line;
+
+        while (getline(ifs, line))
+        {
+            if (line.find(include_file) != std::string::npos)
+                return true;
+        }
+
+        return false;
+    }
+
+    static void run(const std::string &command, const std::string &path)
+    {
+        const int status =system(command.c_str());
+
+        if (status == -1
+            || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            throw generic_exception{"git config failed (" + path + ")"};
+        }
+    }
+
+    class profile_applier : public git_dir_functor {
+        unsigned int &count;
+    public:
+        profile_applier(unsigned int &c)
+            : count(c) {}
+
+        virtual void operator() (const std::string &path) const
+        {
+            try {
+                const cgitrc rc =cgitrc::import_from_file(path + "/cgitrc");
+
+                if (repository_profile::apply(path, rc.get_profile()))
+                    ++count;
+            }
+            catch (import_exception) {
+            }
+            catch (generic_exception &e) {
+                std::cerr << e << "\n";
+            }
+            catch (stdlib_exception &e) {
+                std::cerr << e << "\n";
+            }
+        }
+    };
+}
+
+// *********************************************************
+
+bool repository_profile::apply(const std::string &path, const std::string &name)
+{
+    const std::string file =path + '/' + include_file;
+
+    if (name.empty())
+    {
+        if (access(file.c_str(), F_OK) != 0)
+            return false;
+
+        std::ostringstream command_oss;
+        escape_bash escape{command_oss};
+
+        remove_include(command_oss, path);
+        command_oss << "rm -f ";
+        escape << file;
+
+        // git config fails when there's nothing to remove; what counts is
+        // that the include is gone
+        run(command_oss.str(), path);
+
+        if (config_includes(path))
+            throw generic_exception{"removing the profile failed (" + path + ")"};
+
+        return true;
+    }
+
+    const auto profile =config::repository_profiles.find(name);
+
+    if (profile == config::repository_profiles.end())
+        throw generic_exception{"unknown profile " + name + " (" + path + ")"};
+
+    const std::string text =config_text(profile->second);
+
+    bool written =false;
+
+    {
+        std::ifstream ifs{file};
+
+        if (ifs) {
+            std::ostringstream oss;
+            oss << ifs.rdbuf();
+
+            written =(oss.str() == text);
+        }
+    }
+
+    if (written
+        && include_is_last(path))
+    {
+        return false;
+    }
+
+    if (!written)
+    {
+        std::ostringstream tmp_oss;
+        tmp_oss << file << ".tmp." << getpid();
+
+        const std::string tmp_file =tmp_oss.str();
+
+        {
+            std::ofstream ofs{tmp_file};
+
+            ofs << text;
+
+            if (!ofs.flush()) {
+                unlink(tmp_file.c_str());
+                throw generic_exception{"profile export failed (" + tmp_file + ")"};
+            }
+        }
+
+        if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+            const int error =errno;
+            unlink(tmp_file.c_str());
+            throw stdlib_exception{"rename(" + tmp_file + ", " + file + ")", error};
+        }
+    }
+
+    // a new section is added at the end of the config
+
+    std::ostringstream command_oss;
+    escape_bash escape{command_oss};
+
+    remove_include(command_oss, path);
+    git_command(command_oss, path);
+    command_oss << "config '" << include_section << ".path' " << include_file;
+
+    run(command_oss.str(), path);
+    return true;
+}
+
+unsigned int repository_profile::apply_all()
+{
+    unsigned int count =0;
+
+    for_each_git_dir(profile_applier(count));
+
+    return count;
+}
+
+bool repository_profile::exists(const std::string &name)
+{
+    return config::repository_profiles.count(name) != 0;
+}
+
+std::string repository_profile::names()
+{
+    std::string result;
+
+    for (auto ptr =config::repository_profiles.begin();
+         ptr != config::repository_profiles.end();
+         ++ptr)
+    {
+        if (!result.empty())
+            result += ", ";
+
+        result += ptr->first;
+    }
+
+    return result;
+}
@@ -0,0 +1,35 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_REPOSITORY_PROFILE_HEADER
+#define GIT_JUNCTION_REPOSITORY_PROFILE_HEADER
+
+#include <string>
+
+// Named sets of git config for repositories of a kind, defined in
+// config::repository_profiles and chosen by "profile=<name>" in cgitrc.
+// The settings of a repository's profile are written into
+// <repository>/junction-profile, which the last section of the
+// repository's config includes, so they win over its own settings; the
+// include is moved back there when applied again. Changing a profile in
+// config.cc takes effect once the profiles are applied again, which
+// junction-maint does on every pass.
+
+class repository_profile {
+public:
+    // an empty name removes the settings; returns true if they changed
+    static bool apply(const std::string &path, const std::string &name);
+
+    // applies the profile of every repository; returns how many changed
+    static unsigned int apply_all();
+
+    static bool exists(const std::string &name);
+
+    // the names of the profiles, separated by commas
+    static std::string names();
+};
+
+#endif
@@ -0,0 +1,173 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "response_cache.hh"
+#include "config.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <cerrno>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum {
+        stale_tmp_age =3600,    // seconds
+    };
+
+    static std::string tmp_name(const std::string &dir)
+    {
+        std::ostringstream oss;
+        oss << dir << "/.tmp-" << getpid();
+        return oss.str();
+    }
+
+    struct cache_file {
+        std::string path;
+        time_t mtime;
+        unsigned long long size;
+    };
+}
+
+// *********************************************************
+
+response_cache::writer::writer(const response_cache &cache, const std::string &key)
+    : tmp_file{tmp_name(cache.dir)},
+      final_file{cache.entry(key)},
+      fd{::open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+{
+}
+
+response_cache::writer::~writer()
+{
+    if (fd >= 0) {
+        close(fd);
+        unlink(tmp_file.c_str());
+    }
+}
+
+void response_cache::writer::write(const void *data, size_t size)
+{
+    const char *ptr =static_cast<const char *>(data);
+
+    while (fd >= 0
+           && size > 0)
+    {
+        const ssize_t result =::write(fd, ptr, size);
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+
+            close(fd);
+            fd =-1;
+            unlink(tmp_file.c_str());
+            break;
+        }
+
+        ptr += result;
+        size -= result;
+    }
+}
+
+void response_cache::writer::commit()
+{
+    if (fd < 0)
+        return;
+
+    close(fd);
+    fd =-1;
+
+    if (rename(tmp_file.c_str(), final_file.c_str()) != 0)
+        unlink(tmp_file.c_str());
+}
+
+// *********************************************************
+
+response_cache::response_cache(const std::string &name, unsigned long long m)
+    : dir{config::cache_path + '/' + name},
+      max_size{m}
+{
+    // without the directory every lookup misses and nothing gets stored
+    mkdir(dir.c_str(), 0755);
+}
+
+int response_cache::open(const std::string &key) const
+{
+    const int fd =::open(entry(key).c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd >= 0)
+        futimens(fd, nullptr);
+
+    return fd;
+}
+
+void response_cache::evict() const
+{
+    std::vector<cache_file> files;
+    unsigned long long total =0;
+
+    const time_t now =time(0);
+
+    DIR *d =opendir(dir.c_str());
+
+    if (!d)
+        return;
+
+    while (struct dirent *dirent =readdir(d))
+    {
+        const std::string name =dirent->d_name;
+
+        if (name == "." || name == "..")
+            continue;
+
+        const std::string path =dir + '/' + name;
+        struct stat st;
+
+        if (stat(path.c_str(), &st) != 0
+            || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        if (name[0] == '.') {
+            // leftovers of writers that died
+            if (now - st.st_mtime > stale_tmp_age)
+                unlink(path.c_str());
+            continue;
+        }
+
+        files.push_back(cache_file{path, st.st_mtime, static_cast<unsigned long long>(st.st_size)});
+        total += st.st_size;
+    }
+
+    closedir(d);
+
+    if (total <= max_size)
+        return;
+
+    std::sort(files.begin(),
+              files.end(),
+              [](const cache_file &left, const cache_file &right) { return left.mtime < right.mtime; });
+
+    for (auto ptr =files.begin();
+         ptr != files.end() && total > max_size;
+         ++ptr)
+    {
+        if (unlink(ptr->path.c_str()) == 0)
+            total -= ptr->size;
+    }
+}
@@ -0,0 +1,57 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_RESPONSE_CACHE_HEADER
+#define GIT_JUNCTION_RESPONSE_CACHE_HEADER
+
+#include <string>
+#include <cstddef>
+
+// Size-bounded on-disk cache of protocol responses, one file per key under
+// config::cache_path/<name>. The modification time of an entry is its last
+// use, and the least recently used entries are evicted first. A broken
+// cache directory only makes every lookup miss.
+
+class response_cache {
+    const std::string dir;
+    const unsigned long long max_size;
+
+public:
+    // Writes a new entry into a temporary file. Write errors (like a full
+    // disk) only disable the writer, they never fail the connection.
+
+    class writer {
+        const std::string tmp_file;
+        const std::string final_file;
+        int fd;
+
+    public:
+        writer(const response_cache &, const std::string &key);
+        ~writer();
+
+        writer(const writer &) =delete;
+        writer &operator= (const writer &) =delete;
+
+        void write(const void *data, size_t size);
+
+        // publishes the entry; without commit() it is discarded
+        void commit();
+    };
+
+    // *****
+
+    response_cache(const std::string &name, unsigned long long max_size);
+
+    const std::string &get_dir() const { return dir; }
+    std::string entry(const std::string &key) const { return dir + '/' + key; }
+
+    // returns a readable fd of the entry and marks it used, or -1 on a miss
+    int open(const std::string &key) const;
+
+    void evict() const;
+};
+
+#endif
@@ -0,0 +1,139 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "sha256.hh"
+
+#include <algorithm>
+#include <cstring>
+
+//
+
+namespace
+{
+    static const uint32_t k[64] {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    static inline uint32_t rotr(uint32_t x, unsigned int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+}
+
+// *********************************************************
+
+sha256::sha256()
+    : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+      length{0},
+      block_size{0}
+{
+}
+
+void sha256::transform(const unsigned char *data)
+{
+    uint32_t w[64];
+
+    for (unsigned int i =0; i < 16; ++i)
+    {
+        w[i] = (uint32_t(data[i*4]) << 24)
+            | (uint32_t(data[i*4 + 1]) << 16)
+            | (uint32_t(data[i*4 + 2]) << 8)
+            | uint32_t(data[i*4 + 3]);
+    }
+
+    for (unsigned int i =16; i < 64; ++i)
+    {
+        const uint32_t s0 =rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        const uint32_t s1 =rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+
+        w[i] =w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a =state[0], b =state[1], c =state[2], d =state[3];
+    uint32_t e =state[4], f =state[5], g =state[6], h =state[7];
+
+    for (unsigned int i =0; i < 64; ++i)
+    {
+        const uint32_t s1 =rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        const uint32_t ch =(e & f) ^ (~e & g);
+        const uint32_t t1 =h + s1 + ch + k[i] + w[i];
+        const uint32_t s0 =rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        const uint32_t maj =(a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2 =s0 + maj;
+
+        h =g; g =f; f =e; e =d + t1;
+        d =c; c =b; b =a; a =t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+sha256 &sha256::update(const void *data, size_t size)
+{
+    const unsigned char *ptr =static_cast<const unsigned char *>(data);
+
+    length += size;
+
+    if (block_size > 0)
+    {
+        const size_t fill =std::min(size, sizeof(block) - block_size);
+
+        memcpy(block + block_size, ptr, fill);
+        block_size += fill;
+        ptr += fill;
+        size -= fill;
+
+        if (block_size < sizeof(block))
+            return *this;
+
+        transform(block);
+        block_size =0;
+    }
+
+    for (; size >= sizeof(block); ptr += sizeof(block), size -= sizeof(block))
+        transform(ptr);
+
+    memcpy(block, ptr, size);
+    block_size =size;
+
+    return *this;
+}
+
+std::string sha256::hex_digest()
+{
+    const uint64_t bits =length * 8;
+
+    static const unsigned char padding[64] {0x80};
+    update(padding, 1 + ((119 - length % 64) % 64));
+
+    unsigned char bits_be[8];
+
+    for (unsigned int i =0; i < 8; ++i)
+        bits_be[i] =bits >> (56 - i*8);
+
+    update(bits_be, sizeof(bits_be));
+
+    //
+
+    static const char hex[] ="0123456789abcdef";
+    std::string result;
+
+    for (unsigned int i =0; i < 8; ++i)
+    {
+        for (int shift =28; shift >= 0; shift -= 4)
+            result += hex[(state[i] >> shift) & 0xf];
+    }
+
+    return result;
+}
@@ -0,0 +1,34 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_SHA256_HEADER
+#define GIT_JUNCTION_SHA256_HEADER
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// FIPS 180-4 SHA-256, for cache keys and content addressing. junction-shell
+// can't afford to run config::hashsum_bin for every connection.
+
+class sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t block_size;
+
+    void transform(const unsigned char *);
+
+public:
+    sha256();
+
+    sha256 &update(const void *data, size_t size);
+    sha256 &update(const std::string &data) { return update(data.data(), data.size()); }
+
+    std::string hex_digest();
+};
+
+#endif
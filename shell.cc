@@ -7,113 +7,617 @@
 #include "config.hh"
 #include "quote.h"
 #include "cgitrc.hh"
+#include "access_map.hh"
+#include "activity_table.hh"
+#include "cgroup.hh"
+#include "connection_registry.hh"
+#include "shell_stats.hh"
+#include "fair_semaphore.hh"
+#include "upload_pack_proxy.hh"
+#include "upload_archive_proxy.hh"
+#include "git_process.hh"
+#include "lfs_transfer.hh"
+#include "fd_io.hh"
+#include "probes.hh"
+#include "ref_lock.hh"
+#include "replica.hh"
+#include "transfer_log.hh"
 #include "exception.hh"
 
-#include <vector>
 #include <string>
-#include <iostream>
-#include <sstream>
 
+#include <climits>
+#include <cstdio>
 #include <cstring>
 #include <cerrno>
+#include <csignal>
+#include <ctime>
 
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
-int main(int argc, char *argv[])
+//
+
+// everything up to exec avoids iostreams and, unless a feature needs it,
+// the heap; this runs for every git command
+
+namespace
 {
-    const std::string gjuser{getenv("GJUSER")};
+    // "message (detail)" to stderr, which the client sees; returns the exit status
 
-    if (gjuser.size() < config::user_min_size
-        || gjuser.size() > config::user_max_size)
+    static int fail(const char *message, const char *detail =nullptr)
     {
-        std::cerr << "missing/invalid environment variable GJUSER\n";
+        struct iovec iov[4];
+        int count =0;
+
+        iov[count++] ={const_cast<char *>(message), strlen(message)};
+
+        if (detail) {
+            iov[count++] ={const_cast<char *>(" ("), 2};
+            iov[count++] ={const_cast<char *>(detail), strlen(detail)};
+            iov[count++] ={const_cast<char *>(")\n"), 2};
+        }
+        else {
+            iov[count++] ={const_cast<char *>("\n"), 1};
+        }
+
+        ssize_t result =writev(STDERR_FILENO, iov, count);
+        (void)result;
+
         return 1;
     }
 
-    //
+    static bool has_parent_component(const char *path)
+    {
+        for (const char *ptr =path;
+             (ptr =strstr(ptr, ".."));
+             ptr += 2)
+        {
+            if ((ptr == path || ptr[-1] == '/')
+                && (ptr[2] == 0 || ptr[2] == '/'))
+            {
+                return true;
+            }
+        }
 
-    const std::vector<std::string> args{argv + 1, argv + argc};
+        return false;
+    }
 
-    if (args[0] != "-c") {
-        std::cerr << "arguments don't seem to be shell commands\n";
-        return 1;
+    // 'base' followed by 'path' as "/a/b", the spelling for_each_git_dir()
+    // uses: empty and "." components are dropped, so "a//b/", "./a/b" and
+    // "/a/./b" all find the same repository. Returns the length, or -1 if
+    // it doesn't fit.
+
+    static int normalize_path(char *out, size_t size, const char *base, const char *path)
+    {
+        size_t used =strlen(base);
+
+        if (used >= size)
+            return -1;
+
+        memcpy(out, base, used);
+
+        while (*path)
+        {
+            const char *end =strchrnul(path, '/');
+            const size_t length =end - path;
+
+            if (length != 0
+                && !(length == 1 && *path == '.'))
+            {
+                if (used + 1 + length >= size)
+                    return -1;
+
+                out[used++] ='/';
+                memcpy(out + used, path, length);
+                used += length;
+            }
+
+            path = *end ? end + 1 : end;
+        }
+
+        out[used] =0;
+        return used;
     }
 
-    std::istringstream iss(args[1]);
+    static bool parse_command(const char *command, shell_stats::command_t &type)
+    {
+        if (strcmp(command, "git-upload-pack") == 0)
+            type =shell_stats::c_upload_pack;
+        else if (strcmp(command, "git-receive-pack") == 0)
+            type =shell_stats::c_receive_pack;
+        else if (strcmp(command, "git-upload-archive") == 0)
+            type =shell_stats::c_upload_archive;
+        else if (strcmp(command, "git-lfs-transfer") == 0 && config::lfs_transfer)
+            type =shell_stats::c_lfs_transfer;
+        else
+            return false;
 
-    std::string command;
+        return true;
+    }
 
-    if (!(iss >> command >> std::ws
-          && (command == "git-receive-pack"
-              || command == "git-upload-pack"
-              || command == "git-upload-archive")))
+    // GIT_PROTOCOL (passed by sshd, see AcceptEnv) is a colon separated
+    // list of key[=value]; only a valid "version=<n>" is passed on to git.
+    // Returns the protocol version, 0 if the client didn't ask for any.
+
+    static int accept_git_protocol()
     {
-        std::cerr << "only git commands are supported (" << command << ")\n";
-        return 1;
+        const char *protocol =getenv("GIT_PROTOCOL");
+        int version =0;
+
+        for (const char *ptr =protocol;
+             ptr && *ptr;
+             )
+        {
+            const char *end =strchrnul(ptr, ':');
+
+            if (end - ptr == 9
+                && strncmp(ptr, "version=", 8) == 0
+                && ptr[8] >= '0'
+                && ptr[8] <= '2')
+            {
+                version =ptr[8] - '0';
+            }
+
+            ptr = *end ? end + 1 : end;
+        }
+
+        // setenv() allocates, so only when the value changes
+
+        static const char *const values[] {nullptr, "version=1", "version=2"};
+
+        if (!values[version])
+            unsetenv("GIT_PROTOCOL");
+        else if (strcmp(protocol, values[version]) != 0)
+            setenv("GIT_PROTOCOL", values[version], 1);
+
+        return version;
+    }
+
+    // waits for a slot of the repository, of the user and a global one, in
+    // that order; the slots are held by this process, which waits for the
+    // git command (see exec_git()). Returns true if slots are held.
+
+    static bool admit(const char *gjuser, const char *path)
+    {
+        if (config::connection_limit_per_repository == 0
+            && config::connection_limit_per_user == 0
+            && config::connection_limit_global == 0)
+        {
+            return false;
+        }
+
+        try {
+            char repo_name[32];
+            snprintf(repo_name, sizeof(repo_name), "repo-%llx",
+                     static_cast<unsigned long long>(access_map::hash(path, strlen(path))));
+
+            fair_semaphore repo_slot{repo_name, path, config::connection_limit_per_repository};
+            fair_semaphore user_slot{std::string{"user-"} + gjuser, gjuser, config::connection_limit_per_user};
+            fair_semaphore global_slot{"global", "all connections", config::connection_limit_global};
+
+            repo_slot.acquire();
+            user_slot.acquire();
+            global_slot.acquire();
+
+            repo_slot.keep();
+            user_slot.keep();
+            global_slot.keep();
+
+            return true;
+        }
+        catch (stdlib_exception) {
+            // admission control must not lock everybody out when config::run_path is broken
+            return false;
+        }
+    }
+
+    // a push waits while ref_format::migrate() rewrites the refs; the lock
+    // is held like the slots. Returns true if it is held.
+
+    static bool hold_refs(const char *path)
+    {
+        try {
+            ref_lock lock{path};
+
+            if (!lock.try_lock_shared()) {
+                fail("waiting for the refs of the repository to be migrated");
+                lock.lock_shared();
+            }
+
+            lock.keep();
+            return true;
+        }
+        catch (stdlib_exception) {
+            // a migration can't take the lock either
+            return false;
+        }
+    }
+
+    // *****
+
+    static pid_t git_pid;
+
+    static void forward_signal(int signal)
+    {
+        kill(git_pid, signal);
+    }
+
+    // execs the git command; with 'hold', it runs as a child instead, and
+    // this process keeps the slots and locks (close-on-exec) until it
+    // exits. Git's own descendants, like the "git gc --auto" that
+    // git-receive-pack leaves running in the background, hold nothing.
+
+    static int exec_git(const char *command_bin, const char *command, const char *path, bool hold)
+    {
+        if (hold)
+        {
+            git_pid =fork();
+
+            if (git_pid < 0)
+                return fail("fork", strerror(errno));
+
+            if (git_pid > 0)
+            {
+                signal(SIGHUP, forward_signal);
+                signal(SIGINT, forward_signal);
+                signal(SIGTERM, forward_signal);
+
+                int status;
+
+                while (waitpid(git_pid, &status, 0) < 0)
+                {
+                    if (errno != EINTR)
+                        return fail("waitpid", strerror(errno));
+                }
+
+                return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+        }
+
+        execl(command_bin,
+              command,
+              path,
+              static_cast<char*>(0));
+
+        fail("exec", strerror(errno));
+
+        if (hold)
+            _exit(2);
+
+        return 2;
+    }
+
+    // gives git-pack-objects an equal share of the thread and window memory
+    // budgets; the share is fixed when the connection starts
+
+    static void budget_pack_objects(unsigned int connections)
+    {
+        char parameters[128] ="";
+
+        if (config::pack_thread_budget != 0)
+        {
+            const unsigned int threads =config::pack_thread_budget / connections;
+
+            snprintf(parameters, sizeof(parameters), "'pack.threads=%u'", threads ? threads : 1);
+        }
+
+        if (config::pack_window_memory_budget_mib != 0)
+        {
+            const unsigned int mib =config::pack_window_memory_budget_mib / connections;
+            const size_t used =strlen(parameters);
+
+            snprintf(parameters + used, sizeof(parameters) - used, "%s'pack.windowMemory=%um'",
+                     used ? " " : "", mib ? mib : 1);
+        }
+
+        setenv("GIT_CONFIG_PARAMETERS", parameters, 1);
+    }
+
+    // fails a connection that isn't authorized for 'path'
+
+    static int deny(const char *gjuser, const char *path, const shell_stats::timer &timer,
+                    const char *message, const char *detail =nullptr)
+    {
+        PROBE4(authorize, gjuser, path, 0, timer.elapsed());
+
+        return fail(message, detail);
+    }
+
+    static uint64_t monotonic_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    // runs git as a child instead of exec'ing it, and splices the traffic
+    // through, so that the bytes moved can be logged
+
+    static int relay_command(const std::string &gjuser, const std::string &command, const std::string &path)
+    {
+        const uint64_t start =monotonic_ns();
+
+        unsigned long long bytes_in =0;
+        unsigned long long bytes_out =0;
+        int status;
+
+        try {
+            git_process git{command, {path}};
+
+            // a client going away must show up as EPIPE, not kill us before logging
+            signal(SIGPIPE, SIG_IGN);
+
+            try {
+                splice_relay(STDIN_FILENO, STDOUT_FILENO, git.in(), git.out(), bytes_in, bytes_out);
+                status =git.wait();
+            }
+            catch (stdlib_exception &e) {
+                report("relay", e);
+                git.kill();
+                status =2;
+            }
+        }
+        catch (stdlib_exception &e) {
+            report("relay", e);
+            return 2;
+        }
+
+        transfer_log::append(gjuser, command, path, bytes_in, bytes_out, monotonic_ns() - start, status);
+
+        return status;
+    }
+}
+
+// *********************************************************
+
+int main(int argc, char *argv[])
+{
+    shell_stats::timer timer;
+
+    const char *gjuser =getenv("GJUSER");
+
+    if (!gjuser
+        || strlen(gjuser) < config::user_min_size
+        || strlen(gjuser) > config::user_max_size)
+    {
+        return fail("missing/invalid environment variable GJUSER");
+    }
+
+    // as the login shell: -c "<command>"; as a forced command, sshd passes
+    // the command line in SSH_ORIGINAL_COMMAND
+
+    char *line;
+
+    if (argc == 3
+        && strcmp(argv[1], "-c") == 0)
+    {
+        line =argv[2];
     }
+    else if (argc == 1
+             && (line =getenv("SSH_ORIGINAL_COMMAND")))
+    {
+    }
+    else
+    {
+        return fail("arguments don't seem to be shell commands");
+    }
+
+    PROBE2(connection_start, gjuser, line);
+
+    // split in place: the command, and the rest as its argument
+
+    char *command =line + strspn(line, " \t\n");
+    char *quoted_path =command + strcspn(command, " \t\n");
+
+    if (*quoted_path) {
+        *quoted_path++ = 0;
+        quoted_path += strspn(quoted_path, " \t\n");
+    }
+
+    shell_stats::command_t command_type;
+
+    if (!parse_command(command, command_type))
+        return fail("only git commands are supported", command);
 
     // TODO: skip arguments starting with "--"
 
-    std::string quoted_path;
+    if (!*quoted_path)
+        return fail("failed to read the command argument");
+
+    // git-lfs-transfer <path> upload|download
+
+    const char *operation =nullptr;
 
-    if (!getline(iss, quoted_path)
-        || quoted_path.empty())
+    if (command_type == shell_stats::c_lfs_transfer)
     {
-        std::cerr << "failed to read the command argument\n";
-        return 1;
+        char *space =strrchr(quoted_path, ' ');
+
+        if (!space)
+            return fail("failed to read the command argument");
+
+        *space =0;
+        operation =space + 1;
+
+        if (strcmp(operation, "upload") != 0
+            && strcmp(operation, "download") != 0)
+        {
+            return fail("unknown git-lfs-transfer operation", operation);
+        }
     }
 
-    char buffer[quoted_path.size() + 1];
-    memcpy(buffer, quoted_path.data(), quoted_path.size());
-    buffer[quoted_path.size()] = 0;
+    const int protocol_version =accept_git_protocol();
+
+    if (command_type == shell_stats::c_upload_pack
+        && config::require_protocol_v2
+        && protocol_version != 2)
+    {
+        return fail("this server requires git protocol version 2, try: git -c protocol.version=2 ...");
+    }
+
+    timer.lap(shell_stats::p_parse);
+
+    // git-lfs may leave the path unquoted
 
     const char *dequoted_path;
 
-    if (!(dequoted_path =sq_dequote(buffer))) {
-        std::cerr << "failing to dequote the project directory\n";
-        return 1;
+    if (command_type == shell_stats::c_lfs_transfer
+        && *quoted_path != '\'')
+    {
+        dequoted_path =quoted_path;
     }
+    else if (!(dequoted_path =sq_dequote(quoted_path)))
+    {
+        return fail("failing to dequote the project directory");
+    }
+
+    if (has_parent_component(dequoted_path))
+        return fail("relative path components are not allowed");
 
-    const std::string path =config::base_path + dequoted_path;
+    char path[PATH_MAX];
+    const int path_size =normalize_path(path, sizeof(path), config::base_path.c_str(), dequoted_path);
+
+    if (path_size < 0)
+    {
+        return fail("failing to find a git repository in that directory", dequoted_path);
+    }
 
-    //
+    timer.lap(shell_stats::p_dequote);
+
+    // the compiled access map is authoritative when it exists; unknown
+    // paths are rejected without touching the repository tree
+
+    unsigned int repo_flags =0;
+    bool mirrored =false;
 
     try {
-        const cgitrc rc{cgitrc::import_from_file(path + "/cgitrc")};
+        const access_map map{config::access_map_file};
+        const access_map::entry *entry =map.find(path, path_size);
 
-        if (rc.get_owner() != gjuser) {
-            std::cerr << "you don't seem to be the owner of this repository\n";
-            return 1;
-        }
+        if (!entry)
+            return deny(gjuser, path, timer, "failing to find a git repository in that directory", path);
+
+        if (strcmp(gjuser, entry->owner) != 0)
+            return deny(gjuser, path, timer, "you don't seem to be the owner of this repository");
+
+        repo_flags =entry->flags;
+        mirrored   =(entry->type == static_cast<uint8_t>(cgitrc::repo_type::mirrored));
     }
     catch (import_exception) {
-        std::cerr << "failing to find a git repository in that directory (" << path << ")\n";
-        return 1;
+        try {
+            const cgitrc rc{cgitrc::import_from_file(std::string{path} + "/cgitrc")};
+
+            if (rc.get_owner() != gjuser)
+                return deny(gjuser, path, timer, "you don't seem to be the owner of this repository");
+
+            repo_flags =rc.get_flags();
+            mirrored   =(rc.get_type() == cgitrc::repo_type::mirrored);
+        }
+        catch (import_exception) {
+            return deny(gjuser, path, timer, "failing to find a git repository in that directory", path);
+        }
     }
 
-    // quoting the modified path like the git-shell wants it quoted
+    timer.lap(shell_stats::p_lookup);
 
-    std::ostringstream oss;
+    PROBE4(authorize, gjuser, path, 1, timer.elapsed());
 
-    oss << command << " '";
+    bool holding =admit(gjuser, path);
 
-    for (auto ptr = path.begin();
-         ptr != path.end();
-         ++ptr)
+    if (command_type == shell_stats::c_receive_pack
+        && hold_refs(path))
     {
-        if (need_bs_quote(*ptr))
-            oss << "̈́'\\" << *ptr << "'";
-        else
-            oss << *ptr;
+        holding =true;
+    }
+
+    timer.lap(shell_stats::p_admission);
+
+    if (!config::cgroup_path.empty()
+        && !cgroup::enter(cgroup::classify(gjuser, path, mirrored)))
+    {
+        shell_stats::increment(shell_stats::k_cgroup_unconfined);
+    }
+
+    activity_table::touch(access_map::hash(path, path_size), path, command_type);
+
+    if (config::pack_thread_budget != 0
+        || config::pack_window_memory_budget_mib != 0)
+    {
+        const unsigned int connections =connection_registry::enter();
+
+        if (command_type == shell_stats::c_upload_pack)
+            budget_pack_objects(connections);
+    }
+
+    // fetches may be served by a read replica, pushes always go to the primary
+
+    std::string replica_path;
+
+    if (command_type == shell_stats::c_upload_pack
+        && !config::replica_base_path.empty())
+    {
+        replica_path =replica::route(path + config::base_path.size());
     }
-    oss << '\'';
 
-    execl(config::git_shell_bin,
-          config::git_shell_bin,
-          "-c",
-          oss.str().c_str(),
-          static_cast<char*>(0));
+    const char *git_path =replica_path.empty() ? path : replica_path.c_str();
+
+    if (command_type == shell_stats::c_lfs_transfer)
+    {
+        timer.lap(shell_stats::p_exec);
+        timer.record(command_type);
+
+        PROBE6(exec, gjuser, path, command, "lfs-transfer", timer.duration(shell_stats::p_admission), timer.elapsed());
+
+        return lfs_transfer::serve(path, operation);
+    }
+
+    // the upload-pack proxy speaks protocol v0/v1 only
+
+    if (command_type == shell_stats::c_upload_pack
+        && (config::cache_ref_advertisements
+            || (repo_flags & ((1u << cgitrc::f_upload_pack_cache) | (1u << cgitrc::f_coalesce_fetches))))
+        && protocol_version < 2)
+    {
+        timer.lap(shell_stats::p_exec);
+        timer.record(command_type);
+
+        PROBE6(exec, gjuser, git_path, command, "upload-pack proxy", timer.duration(shell_stats::p_admission), timer.elapsed());
+
+        return upload_pack_proxy::serve(git_path, repo_flags);
+    }
+
+    if (command_type == shell_stats::c_upload_archive
+        && (config::cache_upload_archives || config::archive_gzip_threads != 0))
+    {
+        timer.lap(shell_stats::p_exec);
+        timer.record(command_type);
+
+        PROBE6(exec, gjuser, git_path, command, "upload-archive proxy", timer.duration(shell_stats::p_admission), timer.elapsed());
+
+        return upload_archive_proxy::serve(git_path);
+    }
+
+    if (config::relay_transfers)
+    {
+        timer.lap(shell_stats::p_exec);
+        timer.record(command_type);
+
+        PROBE6(exec, gjuser, git_path, command, "relay", timer.duration(shell_stats::p_admission), timer.elapsed());
+
+        return relay_command(gjuser, command, git_path);
+    }
+
+    // exec the git command directly, without re-entering git-shell
+
+    char command_bin[PATH_MAX];
+    snprintf(command_bin, sizeof(command_bin), "%s/%s", config::git_exec_path, command);
+
+    timer.lap(shell_stats::p_exec);
+    timer.record(command_type);
+
+    PROBE6(exec, gjuser, git_path, command, "exec", timer.duration(shell_stats::p_admission), timer.elapsed());
 
-    std::cerr << "exec: " << strerror(errno) << "\n";
-    return 2;
+    return exec_git(command_bin, command, git_path, holding);
 }
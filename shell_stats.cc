@@ -0,0 +1,193 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "shell_stats.hh"
+#include "config.hh"
+
+#include <ctime>
+
+//
+
+namespace
+{
+    static uint64_t monotonic_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+}
+
+// *********************************************************
+
+const char *shell_stats::phase_name(phase_t phase)
+{
+    switch (phase) {
+    case p_parse:     return "parse";
+    case p_dequote:   return "dequote";
+    case p_lookup:    return "lookup";
+    case p_admission: return "admission";
+    case p_exec:      return "exec";
+    case p_total:     return "total";
+        //
+    case phase_count: break;
+    }
+
+    return "?";
+}
+
+const char *shell_stats::command_name(command_t command)
+{
+    switch (command) {
+    case c_upload_pack:    return "git-upload-pack";
+    case c_receive_pack:   return "git-receive-pack";
+    case c_upload_archive: return "git-upload-archive";
+    case c_lfs_transfer:   return "git-lfs-transfer";
+        //
+    case command_count: break;
+    }
+
+    return "?";
+}
+
+const char *shell_stats::counter_name(counter_t counter)
+{
+    switch (counter) {
+    case k_upload_pack_cache_hit:     return "upload-pack cache hits";
+    case k_upload_pack_cache_miss:    return "upload-pack cache misses";
+    case k_coalesced_fetches:         return "coalesced fetches";
+    case k_advertisement_cache_hit:   return "advertisement cache hits";
+    case k_advertisement_cache_miss:  return "advertisement cache misses";
+    case k_upload_archive_cache_hit:  return "upload-archive cache hits";
+    case k_upload_archive_cache_miss: return "upload-archive cache misses";
+    case k_replica_fetches:           return "fetches served by a replica";
+    case k_replica_lagging:           return "replicas lagging too far";
+    case k_cgroup_unconfined:         return "connections left unconfined";
+        //
+    case counter_count: break;
+    }
+
+    return "?";
+}
+
+unsigned int shell_stats::bucket_index(uint64_t ns)
+{
+    if (ns < (1u << sub_bucket_bits))
+        return ns;
+
+    const unsigned int msb =63 - __builtin_clzll(ns);
+
+    if (msb >= max_bits)
+        return bucket_count - 1;
+
+    const unsigned int sub =(ns >> (msb - sub_bucket_bits)) - (1u << sub_bucket_bits);
+
+    return ((msb - sub_bucket_bits + 1) << sub_bucket_bits) + sub;
+}
+
+uint64_t shell_stats::bucket_value(unsigned int index)
+{
+    if (index < (1u << sub_bucket_bits))
+        return index;
+
+    const unsigned int msb =(index >> sub_bucket_bits) + sub_bucket_bits - 1;
+    const uint64_t sub =index & ((1u << sub_bucket_bits) - 1);
+
+    return ((1u << sub_bucket_bits) + sub) << (msb - sub_bucket_bits);
+}
+
+// *********************************************************
+
+shell_stats::timer::timer()
+    : start{monotonic_ns()},
+      last{start},
+      durations{}
+{
+}
+
+void shell_stats::timer::lap(phase_t phase)
+{
+    const uint64_t now =monotonic_ns();
+
+    durations[phase] =now - last;
+    last =now;
+}
+
+uint64_t shell_stats::timer::elapsed() const
+{
+    return monotonic_ns() - start;
+}
+
+void shell_stats::timer::record(command_t command) const
+{
+    // statistics are best effort, they never prevent a connection
+
+    try {
+        uint64_t final_durations[phase_count];
+
+        for (unsigned int i =0; i < phase_count; ++i)
+            final_durations[i] =durations[i];
+
+        final_durations[p_total] =elapsed();
+
+        shell_stats{true}.record(command, final_durations);
+    }
+    catch (...) {
+    }
+}
+
+// *********************************************************
+
+shell_stats::shell_stats(bool writable)
+    : shm{config::stats_shm_name, sizeof(segment), writable},
+      seg{static_cast<segment *>(shm.get())}
+{
+    if (writable)
+        shm.claim_version(version);
+}
+
+void shell_stats::record(command_t command, const uint64_t (&durations)[phase_count])
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return;
+
+    for (unsigned int i =0; i < phase_count; ++i)
+        __atomic_fetch_add(&seg->counts[command][i][bucket_index(durations[i])], 1, __ATOMIC_RELAXED);
+}
+
+void shell_stats::add(counter_t counter, uint64_t amount)
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return;
+
+    __atomic_fetch_add(&seg->counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+uint64_t shell_stats::count(command_t command, phase_t phase, unsigned int bucket) const
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return 0;
+
+    return __atomic_load_n(&seg->counts[command][phase][bucket], __ATOMIC_RELAXED);
+}
+
+uint64_t shell_stats::counter(counter_t counter) const
+{
+    if (__atomic_load_n(&seg->version, __ATOMIC_RELAXED) != version)
+        return 0;
+
+    return __atomic_load_n(&seg->counters[counter], __ATOMIC_RELAXED);
+}
+
+void shell_stats::increment(counter_t counter)
+{
+    try {
+        shell_stats{true}.add(counter, 1);
+    }
+    catch (...) {
+    }
+}
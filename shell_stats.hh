@@ -0,0 +1,110 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_SHELL_STATS_HEADER
+#define GIT_JUNCTION_SHELL_STATS_HEADER
+
+#include "shm_segment.hh"
+
+#include <cstdint>
+
+// Latency histograms of junction-shell phases, kept in shared memory.
+// Buckets are log-linear (HDR style): values below 2^sub_bucket_bits
+// nanoseconds are exact, above that each power of two is split into
+// 2^sub_bucket_bits buckets. Counters are updated with relaxed atomics.
+
+class shell_stats {
+public:
+    enum phase_t {
+        p_parse,                // GJUSER, arguments and command
+        p_dequote,
+        p_lookup,               // access map or cgitrc
+        p_admission,            // waiting for connection slots
+        p_exec,                 // everything after admission, up to execve
+        p_total,                // from main(), so loading and dynamic linking aren't included
+        //
+        phase_count
+    };
+
+    enum command_t {
+        c_upload_pack,
+        c_receive_pack,
+        c_upload_archive,
+        c_lfs_transfer,
+        //
+        command_count
+    };
+
+    enum counter_t {
+        k_upload_pack_cache_hit,
+        k_upload_pack_cache_miss,
+        k_coalesced_fetches,
+        k_advertisement_cache_hit,
+        k_advertisement_cache_miss,
+        k_upload_archive_cache_hit,
+        k_upload_archive_cache_miss,
+        k_replica_fetches,
+        k_replica_lagging,
+        k_cgroup_unconfined,    // config::cgroup_path set, but cgroup::enter() failed
+        //
+        counter_count
+    };
+
+    enum {
+        version         =9,     // bump when the segment layout changes
+        sub_bucket_bits =4,
+        max_bits        =40,    // ~18 minutes in nanoseconds
+        bucket_count    =(max_bits - sub_bucket_bits + 1) << sub_bucket_bits,
+    };
+
+    struct segment {
+        uint64_t version;
+        uint64_t counts[command_count][phase_count][bucket_count];
+        uint64_t counters[counter_count];
+    };
+
+    static const char *phase_name(phase_t);
+    static const char *command_name(command_t);
+    static const char *counter_name(counter_t);
+
+    static unsigned int bucket_index(uint64_t ns);
+    static uint64_t bucket_value(unsigned int index);
+
+    // *****
+
+    class timer {
+        uint64_t start;
+        uint64_t last;
+        uint64_t durations[phase_count];
+
+    public:
+        timer();
+
+        void lap(phase_t);
+        void record(command_t) const;
+
+        uint64_t duration(phase_t phase) const { return durations[phase]; }
+        uint64_t elapsed() const;
+    };
+
+private:
+    shm_segment shm;
+    segment *seg;
+
+public:
+    shell_stats(bool writable);
+
+    void record(command_t, const uint64_t (&durations)[phase_count]);
+    void add(counter_t, uint64_t amount);
+
+    uint64_t count(command_t, phase_t, unsigned int bucket) const;
+    uint64_t counter(counter_t) const;
+
+    // best effort, like timer::record()
+    static void increment(counter_t);
+};
+
+#endif
@@ -0,0 +1,93 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "shm_segment.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+shm_segment::shm_segment(const char *name, size_t s, bool writable)
+    : data{MAP_FAILED},
+      size{s}
+{
+    const int fd =shm_open(name,
+                           writable ? (O_RDWR | O_CREAT) : O_RDONLY,
+                           0644);
+
+    if (fd < 0)
+        throw stdlib_exception{std::string{"shm_open("} + name + ")", errno};
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        const int error =errno;
+        close(fd);
+        throw stdlib_exception{std::string{"fstat("} + name + ")", error};
+    }
+
+    if (static_cast<size_t>(st.st_size) < size)
+    {
+        // a concurrent creator truncates to the same size, so this is safe
+
+        if (!writable
+            || ftruncate(fd, size) != 0)
+        {
+            const int error = writable ? errno : EINVAL;
+            close(fd);
+            throw stdlib_exception{std::string{"ftruncate("} + name + ")", error};
+        }
+    }
+
+    data =mmap(nullptr,
+               size,
+               writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+               MAP_SHARED,
+               fd,
+               0);
+
+    const int error =errno;
+    close(fd);
+
+    if (data == MAP_FAILED)
+        throw stdlib_exception{std::string{"mmap("} + name + ")", error};
+}
+
+shm_segment::~shm_segment()
+{
+    munmap(data, size);
+}
+
+bool shm_segment::claim_version(uint64_t version)
+{
+    enum : uint64_t { clearing =~uint64_t{0} };
+
+    uint64_t *word =static_cast<uint64_t *>(data);
+    uint64_t seen =__atomic_load_n(word, __ATOMIC_ACQUIRE);
+
+    while (seen < version)      // 0 for a new segment
+    {
+        if (__atomic_compare_exchange_n(word, &seen, uint64_t{clearing}, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            // counters of the old layout mean nothing in the new one
+            if (seen != 0)
+                memset(word + 1, 0, size - sizeof(*word));
+
+            __atomic_store_n(word, version, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+
+    return seen == version;
+}
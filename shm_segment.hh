@@ -0,0 +1,36 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_SHM_SEGMENT_HEADER
+#define GIT_JUNCTION_SHM_SEGMENT_HEADER
+
+#include <cstddef>
+#include <cstdint>
+
+// POSIX shared memory object, mapped for the lifetime of the instance. A
+// writable segment is created zero-filled if it doesn't exist yet. Its
+// layout is identified by a version number in the first 64 bits.
+
+class shm_segment {
+    void *data;
+    size_t size;
+
+public:
+    shm_segment(const char *name, size_t size, bool writable);
+    ~shm_segment();
+
+    shm_segment(const shm_segment &) =delete;
+    shm_segment &operator= (const shm_segment &) =delete;
+
+    void *get() const { return data; }
+
+    // writable: stamps a new segment with 'version', and clears one left
+    // with an older version (e.g. by the previous release) for it; returns
+    // false if the segment is newer, or being cleared by somebody else
+    bool claim_version(uint64_t version);
+};
+
+#endif
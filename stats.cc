@@ -0,0 +1,157 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "shell_stats.hh"
+#include "fair_semaphore.hh"
+#include "exception.hh"
+
+#include <iostream>
+#include <iomanip>
+
+//
+
+namespace
+{
+    // returns the upper edge of the bucket containing the given quantile,
+    // in microseconds
+
+    static double quantile(const shell_stats &stats,
+                           shell_stats::command_t command,
+                           shell_stats::phase_t phase,
+                           uint64_t total,
+                           double q)
+    {
+        const uint64_t rank =static_cast<uint64_t>(q * (total - 1));
+        uint64_t seen =0;
+
+        for (unsigned int i =0; i < shell_stats::bucket_count; ++i)
+        {
+            seen += stats.count(command, phase, i);
+
+            if (seen > rank)
+                return shell_stats::bucket_value(i + 1) / 1000.0;
+        }
+
+        return shell_stats::bucket_value(shell_stats::bucket_count - 1) / 1000.0;
+    }
+
+    static void print_stats(std::ostream &out, const shell_stats &stats)
+    {
+        out << std::left
+            << std::setw(20) << "command"
+            << std::setw(10) << "phase"
+            << std::right
+            << std::setw(10) << "count"
+            << std::setw(12) << "p50 (us)"
+            << std::setw(12) << "p99 (us)"
+            << std::setw(12) << "p999 (us)"
+            << '\n';
+
+        out << std::fixed << std::setprecision(1);
+
+        for (unsigned int c =0; c < shell_stats::command_count; ++c)
+        {
+            const auto command =static_cast<shell_stats::command_t>(c);
+
+            for (unsigned int p =0; p < shell_stats::phase_count; ++p)
+            {
+                const auto phase =static_cast<shell_stats::phase_t>(p);
+
+                uint64_t total =0;
+
+                for (unsigned int i =0; i < shell_stats::bucket_count; ++i)
+                    total += stats.count(command, phase, i);
+
+                if (total == 0)
+                    continue;
+
+                out << std::left
+                    << std::setw(20) << shell_stats::command_name(command)
+                    << std::setw(10) << shell_stats::phase_name(phase)
+                    << std::right
+                    << std::setw(10) << total
+                    << std::setw(12) << quantile(stats, command, phase, total, 0.5)
+                    << std::setw(12) << quantile(stats, command, phase, total, 0.99)
+                    << std::setw(12) << quantile(stats, command, phase, total, 0.999)
+                    << '\n';
+            }
+        }
+    }
+
+    static void print_counters(std::ostream &out, const shell_stats &stats)
+    {
+        out << '\n';
+
+        for (unsigned int c =0; c < shell_stats::counter_count; ++c)
+        {
+            const auto counter =static_cast<shell_stats::counter_t>(c);
+
+            out << std::left
+                << std::setw(40) << shell_stats::counter_name(counter)
+                << std::right
+                << std::setw(10) << stats.counter(counter)
+                << '\n';
+        }
+    }
+
+    static void print_queues(std::ostream &out)
+    {
+        std::vector<std::string> names;
+
+        try {
+            names =fair_semaphore::names();
+        }
+        catch (stdlib_exception) {
+            // admission control not in use
+        }
+
+        if (names.empty())
+            return;
+
+        out << '\n'
+            << std::left
+            << std::setw(30) << "queue"
+            << std::right
+            << std::setw(10) << "waiting"
+            << "  label\n";
+
+        for (auto ptr =names.begin();
+             ptr != names.end();
+             ++ptr)
+        {
+            out << std::left
+                << std::setw(30) << *ptr
+                << std::right
+                << std::setw(10) << fair_semaphore::queue_depth(*ptr)
+                << "  " << fair_semaphore::label(*ptr)
+                << '\n';
+        }
+    }
+}
+
+// *********************************************************
+
+int main()
+{
+    enum {
+        return_ok =0,
+        return_stdlib_error,
+    };
+
+    try {
+        const shell_stats stats{false};
+
+        print_stats(std::cout, stats);
+        print_counters(std::cout, stats);
+        print_queues(std::cout);
+    }
+    catch (stdlib_exception &e) {
+        std::cerr << "junction-stats: " << e << "\n";
+        return return_stdlib_error;
+    }
+
+    return return_ok;
+}
@@ -0,0 +1,47 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "transfer_log.hh"
+#include "config.hh"
+
+#include <cstdio>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+
+void transfer_log::append(const std::string &user, const std::string &command, const std::string &path,
+                          unsigned long long bytes_in, unsigned long long bytes_out,
+                          uint64_t duration_ns, int status)
+{
+    const int fd =open(config::transfer_log_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+
+    if (fd < 0)
+        return;
+
+    char line[config::user_max_size + 4096];
+
+    const int size =snprintf(line, sizeof(line), "%lld %s %s %llu %llu %llu %d %s\n",
+                             static_cast<long long>(time(nullptr)),
+                             user.c_str(),
+                             command.c_str(),
+                             bytes_in,
+                             bytes_out,
+                             static_cast<unsigned long long>(duration_ns / 1000000),
+                             status,
+                             path.c_str());
+
+    if (size > 0
+        && size_t(size) < sizeof(line))
+    {
+        ssize_t result =write(fd, line, size);
+        (void)result;
+    }
+
+    close(fd);
+}
@@ -0,0 +1,29 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_TRANSFER_LOG_HEADER
+#define GIT_JUNCTION_TRANSFER_LOG_HEADER
+
+#include <string>
+#include <cstdint>
+
+// One line per relayed git command in config::transfer_log_file:
+//
+//   <unix time> <user> <command> <bytes in> <bytes out> <duration ms> <exit status> <path>
+//
+// Bytes in are from the client to git. Each line is a single O_APPEND
+// write(), so concurrent junction-shells never interleave; summing per
+// repository or per user is left to the reader (e.g. awk).
+
+namespace transfer_log
+{
+    // best effort, failures are ignored
+    void append(const std::string &user, const std::string &command, const std::string &path,
+                unsigned long long bytes_in, unsigned long long bytes_out,
+                uint64_t duration_ns, int status);
+}
+
+#endif
@@ -0,0 +1,381 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "upload_archive_proxy.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "fd_io.hh"
+#include "parallel_gzip.hh"
+#include "response_cache.hh"
+#include "sha256.hh"
+#include "shell_stats.hh"
+
+#include <memory>
+#include <sstream>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    // git archive options whose value may be the next argument
+
+    static bool takes_value(const std::string &option)
+    {
+        static const char *const options[] {
+            "--format", "--prefix", "--output", "-o", "--add-file", "--add-virtual-file",
+            "--mtime", "--remote", "--exec",
+        };
+
+        for (unsigned int i =0; i < sizeof(options) / sizeof(options[0]); ++i)
+        {
+            if (option == options[i])
+                return true;
+        }
+
+        return false;
+    }
+
+    // the object id 'revision' resolves to, or an empty string
+
+    static std::string resolve(const std::string &path, const std::string &revision)
+    {
+        git_process git{"git", {"--git-dir=" + path, "rev-parse", "--verify", "--quiet",
+                                "--end-of-options", revision}};
+
+        git.close_input();
+
+        std::string result =read_all(git.out());
+
+        if (git.wait() != 0)
+            return std::string{};
+
+        if (!result.empty() && result.back() == '\n')
+            result.pop_back();
+
+        return result;
+    }
+}
+
+// *********************************************************
+
+upload_archive_proxy::upload_archive_proxy(const std::string &p)
+    : path{p},
+      client_reader{STDIN_FILENO},
+      gzip_level{-1}
+{
+}
+
+// reads the "argument ..." packets up to the flush; false if there is
+// something else
+
+bool upload_archive_proxy::read_request()
+{
+    std::string raw;
+
+    while (client_reader.read(raw))
+    {
+        request += raw;
+
+        if (pkt_line::is_flush(raw))
+            return true;
+
+        const std::string text =pkt_line::text(raw);
+
+        if (text.compare(0, 9, "argument ") != 0)
+            return false;
+
+        arguments.push_back(text.substr(9));
+    }
+
+    return false;
+}
+
+std::string upload_archive_proxy::tree_ish() const
+{
+    for (auto ptr =arguments.begin();
+         ptr != arguments.end();
+         ++ptr)
+    {
+        if (*ptr == "--")
+            return (ptr + 1 != arguments.end()) ? *(ptr + 1) : std::string{};
+
+        if ((*ptr)[0] != '-')
+            return *ptr;
+
+        if (takes_value(*ptr)
+            && ++ptr == arguments.end())
+        {
+            break;
+        }
+    }
+
+    return std::string{};
+}
+
+// an empty key means the response can't be cached
+
+std::string upload_archive_proxy::cache_key() const
+{
+    const std::string revision =tree_ish();
+
+    if (revision.empty())
+        return std::string{};
+
+    std::string id =resolve(path, revision + "^{commit}");
+
+    if (id.empty()
+        && (id =resolve(path, revision + "^{tree}")).empty())
+    {
+        return std::string{};
+    }
+
+    // tar.umask and the like live in the config
+
+    struct stat st;
+    std::ostringstream config_oss;
+
+    if (stat((path + "/config").c_str(), &st) == 0)
+        config_oss << st.st_ino << ' ' << st.st_size << ' ' << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+
+    return sha256{}
+        .update(path).update("", 1)
+        .update(config_oss.str()).update("", 1)
+        .update(request).update("", 1)
+        .update(id)
+        .hex_digest();
+}
+
+// asks git for a tar instead of a tar.gz, taking over the compression
+// level; the request is encoded again from the arguments
+
+void upload_archive_proxy::take_gzip()
+{
+    if (config::archive_gzip_threads == 0)
+        return;
+
+    std::vector<std::string> tar_arguments;
+    bool gzip =false;
+    int level =parallel_gzip::default_level;
+
+    for (auto ptr =arguments.begin();
+         ptr != arguments.end();
+         ++ptr)
+    {
+        if (*ptr == "--format=tgz"
+            || *ptr == "--format=tar.gz")
+        {
+            gzip =true;
+            tar_arguments.push_back("--format=tar");
+        }
+        else if (*ptr == "--format"
+                 && ptr + 1 != arguments.end()
+                 && (*(ptr + 1) == "tgz" || *(ptr + 1) == "tar.gz"))
+        {
+            gzip =true;
+            tar_arguments.push_back("--format=tar");
+            ++ptr;
+        }
+        else if (ptr->size() == 2
+                 && (*ptr)[0] == '-'
+                 && (*ptr)[1] >= '0'
+                 && (*ptr)[1] <= '9')
+        {
+            level =(*ptr)[1] - '0';
+        }
+        else
+        {
+            tar_arguments.push_back(*ptr);
+        }
+    }
+
+    if (!gzip)
+        return;
+
+    request.clear();
+
+    for (auto ptr =tar_arguments.begin();
+         ptr != tar_arguments.end();
+         ++ptr)
+    {
+        request += pkt_line::encode("argument " + *ptr);
+    }
+
+    request += pkt_line::flush;
+    gzip_level =level;
+}
+
+void upload_archive_proxy::copy_response(git_process &git, const sink_t &sink)
+{
+    char buffer[65536];
+
+    for (;;)
+    {
+        const ssize_t result =read(git.out(), buffer, sizeof(buffer));
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (result == 0)
+            return;
+
+        sink(buffer, result);
+    }
+}
+
+// "ACK" and a flush, then sideband packets up to a flush; band 1 (data) is
+// compressed and packed again, progress and errors pass as they are
+
+void upload_archive_proxy::compress_response(git_process &git, const sink_t &sink)
+{
+    pkt_line_reader reader{git.out()};
+    std::string raw;
+
+    if (!reader.read(raw))
+        return;
+
+    sink(raw.data(), raw.size());
+
+    if (pkt_line::text(raw) != "ACK") {
+        const std::string buffered =reader.take_buffered();
+
+        sink(buffered.data(), buffered.size());
+        copy_response(git, sink);
+        return;
+    }
+
+    if (!reader.read(raw))
+        return;
+
+    sink(raw.data(), raw.size());
+
+    parallel_gzip gzip{config::archive_gzip_threads, gzip_level, [&sink](const char *data, size_t size)
+    {
+        const size_t max_data =pkt_line::max_size - 5;     // header and band
+
+        while (size > 0)
+        {
+            const size_t part =(size < max_data) ? size : max_data;
+            const std::string packet =pkt_line::encode('\1' + std::string{data, part});
+
+            sink(packet.data(), packet.size());
+
+            data += part;
+            size -= part;
+        }
+    }};
+
+    while (reader.read(raw))
+    {
+        if (pkt_line::is_flush(raw)) {
+            gzip.finish();
+            sink(raw.data(), raw.size());
+            return;
+        }
+
+        if (raw.size() > 4 && raw[4] == 1)
+            gzip.write(raw.data() + 5, raw.size() - 5);
+        else
+            sink(raw.data(), raw.size());
+    }
+
+    // git died without the final flush; leave the archive unfinished
+}
+
+int upload_archive_proxy::generate(const std::string &key)
+{
+    git_process git{"git-upload-archive", {path}};
+
+    write_all(git.in(), request);
+    write_all(git.in(), client_reader.take_buffered());
+
+    if (key.empty() && gzip_level < 0) {
+        relay(STDIN_FILENO, STDOUT_FILENO, git.in(), git.out());
+        return git.wait();
+    }
+
+    // the client sends nothing after the arguments
+
+    git.close_input();
+
+    const response_cache cache{"upload-archive", config::upload_archive_cache_max_mib * 1024ull * 1024};
+    std::unique_ptr<response_cache::writer> writer;
+
+    if (!key.empty())
+        writer.reset(new response_cache::writer{cache, key});
+
+    const sink_t sink =[&writer](const char *data, size_t size)
+    {
+        write_all(STDOUT_FILENO, data, size);
+
+        if (writer)
+            writer->write(data, size);
+    };
+
+    if (gzip_level < 0)
+        copy_response(git, sink);
+    else
+        compress_response(git, sink);
+
+    const int status =git.wait();
+
+    if (status == 0 && writer) {
+        writer->commit();
+        cache.evict();
+    }
+
+    return status;
+}
+
+// *********************************************************
+
+int upload_archive_proxy::serve(const std::string &path)
+{
+    try {
+        upload_archive_proxy proxy{path};
+
+        const bool complete =proxy.read_request();
+        const std::string key =(complete && config::cache_upload_archives) ? proxy.cache_key() : std::string{};
+
+        if (complete)
+            proxy.take_gzip();
+
+        if (!key.empty())
+        {
+            const response_cache cache{"upload-archive", config::upload_archive_cache_max_mib * 1024ull * 1024};
+
+            const int fd =cache.open(key);
+
+            if (fd >= 0) {
+                copy_fd(fd, STDOUT_FILENO);
+                close(fd);
+
+                shell_stats::increment(shell_stats::k_upload_archive_cache_hit);
+                return 0;
+            }
+
+            shell_stats::increment(shell_stats::k_upload_archive_cache_miss);
+        }
+
+        return proxy.generate(key);
+    }
+    catch (generic_exception &e) {
+        report("upload-archive proxy", e);
+        return 1;
+    }
+    catch (stdlib_exception &e) {
+        report("upload-archive proxy", e);
+        return 2;
+    }
+}
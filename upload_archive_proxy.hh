@@ -0,0 +1,56 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_UPLOAD_ARCHIVE_PROXY_HEADER
+#define GIT_JUNCTION_UPLOAD_ARCHIVE_PROXY_HEADER
+
+#include "git_process.hh"
+#include "pkt_line.hh"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Sits between the client and git-upload-archive, and keeps complete
+// responses in a response_cache. The key is the repository, its config,
+// the client's arguments as sent and the object id the tree-ish resolves
+// to (the commit if there is one, as its time and id end up in the
+// archive; the tree otherwise). The arguments are part of the key, so a
+// hit only ever repeats a request git has already accepted.
+//
+// With config::archive_gzip_threads, tar.gz archives are compressed here
+// on that many threads instead of by git: git is asked for a tar, and the
+// data band of its sideband stream is passed through parallel_gzip.
+
+class upload_archive_proxy {
+    typedef std::function<void (const char *, size_t)> sink_t;
+
+    const std::string path;
+
+    pkt_line_reader client_reader;
+
+    std::string request;
+    std::vector<std::string> arguments;
+
+    int gzip_level;                     // -1 when git compresses
+
+    upload_archive_proxy(const std::string &path);
+
+    bool read_request();
+    std::string tree_ish() const;
+    std::string cache_key() const;
+
+    void take_gzip();
+    void copy_response(git_process &, const sink_t &);
+    void compress_response(git_process &, const sink_t &);
+
+    int generate(const std::string &key);
+
+public:
+    static int serve(const std::string &path);
+};
+
+#endif
@@ -0,0 +1,396 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "upload_pack_proxy.hh"
+#include "config.hh"
+#include "exception.hh"
+#include "fd_io.hh"
+#include "fetch_spool.hh"
+#include "ref_state.hh"
+#include "response_cache.hh"
+#include "sha256.hh"
+#include "shell_stats.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+
+#include <unistd.h>
+
+//
+
+upload_pack_proxy::upload_pack_proxy(const std::string &p, unsigned int f)
+    : path{p},
+      flags{f},
+      client_reader{STDIN_FILENO}
+{
+}
+
+bool upload_pack_proxy::flag(cgitrc::flags_t f) const
+{
+    return flags & (1u << f);
+}
+
+// 'advertised' means the client already has an advertisement from the
+// cache; git's own is then read and dropped
+
+void upload_pack_proxy::start_git(bool advertised)
+{
+    if (advertised)
+    {
+        // a ref may have moved since the cached advertisement was made;
+        // the client may still want its old tip
+
+        const char *parameters =getenv("GIT_CONFIG_PARAMETERS");
+
+        std::string value =(parameters && *parameters) ? std::string{parameters} + ' ' : std::string{};
+        value += "'uploadpack.allowReachableSHA1InWant=true'";
+
+        setenv("GIT_CONFIG_PARAMETERS", value.c_str(), 1);
+    }
+
+    git.reset(new git_process{"git-upload-pack", {path}});
+    git_reader.reset(new pkt_line_reader{git->out()});
+
+    if (advertised)
+    {
+        std::string raw;
+
+        while (git_reader->read(raw)
+               && !pkt_line::is_flush(raw))
+        {
+        }
+    }
+}
+
+// returns true if the advertisement was found in the cache; on a miss,
+// prepares store_advertisement() unless the ref state is racy
+
+bool upload_pack_proxy::load_advertisement()
+{
+    if (!ref_state_fingerprint(path, ref_state))
+        return false;
+
+    const char *protocol =getenv("GIT_PROTOCOL");
+
+    advertisement_key =sha256{}
+        .update(path).update("", 1)
+        .update(protocol ? protocol : "").update("", 1)
+        .update(ref_state)
+        .hex_digest();
+
+    const response_cache cache{"advertisement", config::advertisement_cache_max_mib * 1024ull * 1024};
+
+    const int fd =cache.open(advertisement_key);
+
+    if (fd < 0) {
+        shell_stats::increment(shell_stats::k_advertisement_cache_miss);
+        return false;
+    }
+
+    try {
+        advertisement =read_all(fd);
+    }
+    catch (stdlib_exception) {
+        advertisement.clear();
+    }
+
+    close(fd);
+
+    // anything but a complete advertisement is ignored
+
+    if (advertisement.size() < pkt_line::flush.size()
+        || advertisement.compare(advertisement.size() - pkt_line::flush.size(),
+                                 pkt_line::flush.size(),
+                                 pkt_line::flush) != 0)
+    {
+        advertisement.clear();
+        return false;
+    }
+
+    shell_stats::increment(shell_stats::k_advertisement_cache_hit);
+    return true;
+}
+
+// stores git's advertisement, if the refs didn't change while git read them
+
+void upload_pack_proxy::store_advertisement()
+{
+    std::string after;
+
+    if (advertisement_key.empty()
+        || !ref_state_fingerprint(path, after)
+        || after != ref_state)
+    {
+        return;
+    }
+
+    const response_cache cache{"advertisement", config::advertisement_cache_max_mib * 1024ull * 1024};
+
+    response_cache::writer writer{cache, advertisement_key};
+
+    writer.write(advertisement.data(), advertisement.size());
+    writer.commit();
+
+    cache.evict();
+}
+
+void upload_pack_proxy::forward_advertisement()
+{
+    std::string raw;
+
+    while (git_reader->read(raw))
+    {
+        advertisement += raw;
+
+        if (pkt_line::is_flush(raw))
+            break;
+    }
+
+    write_all(STDOUT_FILENO, advertisement);
+}
+
+// reads the client's wants up to the first flush, and if 'to_done' the
+// packet after it; returns true if the response can be shared
+
+bool upload_pack_proxy::read_request(bool to_done)
+{
+    std::string raw;
+    bool shallow =false;
+
+    while (client_reader.read(raw))
+    {
+        request += raw;
+
+        if (pkt_line::is_flush(raw))
+            break;
+
+        const std::string text =pkt_line::text(raw);
+
+        if (text.compare(0, 8, "shallow ") == 0
+            || text.compare(0, 6, "deepen") == 0)
+        {
+            shallow =true;
+        }
+    }
+
+    // a lone flush means the client wants nothing (like ls-remote); a
+    // shallow client waits for git's shallow list before it goes on
+
+    if (request.empty()
+        || request == pkt_line::flush
+        || shallow
+        || !to_done
+        || !client_reader.read(raw))
+    {
+        return false;
+    }
+
+    request += raw;
+
+    return pkt_line::text(raw) == "done";
+}
+
+bool upload_pack_proxy::wants_nothing() const
+{
+    return request.empty()
+        || request == pkt_line::flush;
+}
+
+int upload_pack_proxy::pass_through()
+{
+    write_all(git->in(), request);
+    write_all(git->in(), client_reader.take_buffered());
+
+    relay(STDIN_FILENO, STDOUT_FILENO, git->in(), git->out());
+
+    return git->wait();
+}
+
+// stops writing after the first failure, which is kept in client_error
+
+void upload_pack_proxy::to_client(const char *data, size_t size)
+{
+    if (client_error)
+        return;
+
+    try {
+        write_all(STDOUT_FILENO, data, size);
+    }
+    catch (stdlib_exception &e) {
+        client_error.reset(new stdlib_exception{e});
+    }
+}
+
+// sends the request to git and streams the response to the client and
+// 'sink'; 'sink' gets all of it even if the client goes away, as followers
+// of a coalesced fetch depend on it
+
+int upload_pack_proxy::generate(const sink_t &sink)
+{
+    // a client going away must show up as EPIPE, not kill the leader
+    signal(SIGPIPE, SIG_IGN);
+
+    write_all(git->in(), request);
+    git->close_input();
+
+    {
+        const std::string buffered =git_reader->take_buffered();
+
+        to_client(buffered.data(), buffered.size());
+        sink(buffered.data(), buffered.size());
+    }
+
+    char buffer[65536];
+
+    for (;;)
+    {
+        const ssize_t result =read(git->out(), buffer, sizeof(buffer));
+
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw stdlib_exception{"read", errno};
+        }
+
+        if (result == 0)
+            break;
+
+        to_client(buffer, result);
+        sink(buffer, result);
+    }
+
+    return git->wait();
+}
+
+int upload_pack_proxy::serve_shared()
+{
+    const response_cache cache{"upload-pack", config::upload_pack_cache_max_mib * 1024ull * 1024};
+
+    const std::string key =sha256{}
+        .update(path).update("", 1)
+        .update(advertisement)
+        .update(request)
+        .hex_digest();
+
+    if (flag(cgitrc::f_upload_pack_cache))
+    {
+        const int fd =cache.open(key);
+
+        if (fd >= 0) {
+            git->kill();
+
+            copy_fd(fd, STDOUT_FILENO);
+            close(fd);
+
+            shell_stats::increment(shell_stats::k_upload_pack_cache_hit);
+            return 0;
+        }
+
+        shell_stats::increment(shell_stats::k_upload_pack_cache_miss);
+    }
+
+    // join an identical fetch in flight, or lead one
+
+    if (flag(cgitrc::f_coalesce_fetches))
+    {
+        fetch_spool spool{config::cache_path + "/spool", key};
+
+        if (!spool.is_leader()) {
+            git->kill();
+
+            shell_stats::increment(shell_stats::k_coalesced_fetches);
+            return spool.follow(STDOUT_FILENO) ? 0 : 1;
+        }
+
+        const int status =generate([&spool](const char *data, size_t size) { spool.write(data, size); });
+
+        if (flag(cgitrc::f_upload_pack_cache)) {
+            spool.finish(status == 0, cache.entry(key));
+            cache.evict();
+        }
+        else {
+            spool.finish(status == 0, std::string{});
+        }
+
+        if (client_error)
+            throw *client_error;
+
+        return status;
+    }
+
+    // cache only
+
+    response_cache::writer writer{cache, key};
+
+    const int status =generate([&writer](const char *data, size_t size) { writer.write(data, size); });
+
+    if (status == 0) {
+        writer.commit();
+        cache.evict();
+    }
+
+    if (client_error)
+        throw *client_error;
+
+    return status;
+}
+
+// *********************************************************
+
+int upload_pack_proxy::serve(const std::string &path, unsigned int flags)
+{
+    try {
+        upload_pack_proxy proxy{path, flags};
+
+        const bool advertised =config::cache_ref_advertisements
+            && proxy.load_advertisement();
+
+        if (advertised) {
+            write_all(STDOUT_FILENO, proxy.advertisement);
+        }
+        else {
+            proxy.start_git(false);
+            proxy.forward_advertisement();
+            proxy.store_advertisement();
+        }
+
+        // only a repository that shares responses needs more of the
+        // request than git needs to start: a fetch of any other is passed
+        // through as soon as possible
+
+        const bool shares =proxy.flag(cgitrc::f_upload_pack_cache)
+            || proxy.flag(cgitrc::f_coalesce_fetches);
+
+        if (!advertised
+            && !shares)
+        {
+            return proxy.pass_through();
+        }
+
+        const bool shareable =proxy.read_request(shares);
+
+        if (advertised) {
+            if (proxy.wants_nothing())
+                return 0;
+
+            proxy.start_git(true);
+        }
+
+        if (shareable)
+            return proxy.serve_shared();
+
+        return proxy.pass_through();
+    }
+    catch (generic_exception &e) {
+        report("upload-pack proxy", e);
+        return 1;
+    }
+    catch (stdlib_exception &e) {
+        report("upload-pack proxy", e);
+        return 2;
+    }
+}
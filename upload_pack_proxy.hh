@@ -0,0 +1,75 @@
+/* git-junction
+ * Copyright (c) 2016-2017 by Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#ifndef GIT_JUNCTION_UPLOAD_PACK_PROXY_HEADER
+#define GIT_JUNCTION_UPLOAD_PACK_PROXY_HEADER
+
+#include "cgitrc.hh"
+#include "exception.hh"
+#include "git_process.hh"
+#include "pkt_line.hh"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// Sits between the client and git-upload-pack (protocol v0/v1), so that the
+// response to a fetch without "have" lines can be shared. The key is the
+// repository, the ref advertisement (which covers the ref state and
+// capabilities) and the client's request; changing a ref changes the key,
+// so nothing needs to be invalidated. Depending on the cgitrc flags the
+// response is
+//
+//  - served from, or stored into, a response_cache (upload-pack-cache)
+//  - generated once for identical concurrent fetches, see fetch_spool
+//    (coalesce-fetches)
+//
+// With config::cache_ref_advertisements, the advertisement itself comes
+// from a response_cache keyed by the ref_state_fingerprint(), and git is
+// only started once the client turns out to want something. That git's
+// own advertisement is discarded.
+
+class upload_pack_proxy {
+    typedef std::function<void (const char *, size_t)> sink_t;
+
+    const std::string path;
+    const unsigned int flags;
+
+    std::unique_ptr<git_process> git;
+    std::unique_ptr<pkt_line_reader> git_reader;
+    pkt_line_reader client_reader;
+
+    std::string advertisement;
+    std::string request;
+
+    std::string ref_state;              // fingerprint, empty if not cacheable
+    std::string advertisement_key;
+
+    // set when the client went away during generate()
+    std::unique_ptr<stdlib_exception> client_error;
+
+    upload_pack_proxy(const std::string &path, unsigned int flags);
+
+    bool flag(cgitrc::flags_t) const;
+
+    void start_git(bool advertised);
+    bool load_advertisement();
+    void store_advertisement();
+
+    void forward_advertisement();
+    bool read_request(bool to_done);
+    bool wants_nothing() const;
+
+    int pass_through();
+    void to_client(const char *data, size_t size);
+    int generate(const sink_t &);
+    int serve_shared();
+
+public:
+    static int serve(const std::string &path, unsigned int flags);
+};
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "utils.hh"
 #include "exception.hh"
+#include "probes.hh"
 #include "process_io.hh"
 
 #include <iostream>
@@ -167,6 +168,24 @@ std::string calc_directory_name(const std::string &user, const std::string &pass
 
 // *********************************************************
 
+bool read_publicity(const std::string &path)
+{
+    std::ostringstream command_oss;
+    escape_bash escape{command_oss};
+
+    command_oss << "git --git-dir=";
+    escape << path;
+    command_oss << " config daemon.receivepack";
+
+    process_io git_config(command_oss.str());
+    std::string line;
+
+    return git_config.read() >> line
+        && line == "true";
+}
+
+// *********************************************************
+
 opendir_raii::opendir_raii(const std::string &path)
     : dir{opendir(path.c_str())}
 {
@@ -231,6 +250,10 @@ static bool is_git_dir(const std::string &path)
 
 void for_each_git_dir(const git_dir_functor &callback, const std::string &path)
 {
+    PROBE1(git_dirs_start, path.c_str());
+
+    const probe_timer timer;
+
     opendir_raii dir{path.c_str()};
     struct dirent *dirent;
 
@@ -258,6 +281,8 @@ void for_each_git_dir(const git_dir_functor &callback, const std::string &path)
             for_each_git_dir(callback, next);
         }
     }
+
+    PROBE2(git_dirs_done, path.c_str(), timer.elapsed());
 }
 
 // *********************************************************
@@ -22,6 +22,7 @@ std::string polish_name(std::string path);
 void filter_new_repository_name(std::string &name);
 bool scan_for_user(const std::string &user);
 std::string calc_directory_name(const std::string &user, const std::string &password);
+bool read_publicity(const std::string &path);
 
 // *****
 